@@ -0,0 +1,179 @@
+/*
+ * alloc_benchmark.cpp -- heap allocation and memory usage benchmark
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+#include "tecalc.hpp"
+
+
+//
+// replaced global allocation functions which count heap allocations
+//
+namespace {
+
+std::atomic<std::size_t> g_alloc_count{0};
+std::atomic<std::size_t> g_alloc_bytes{0};
+
+void* counted_alloc(std::size_t size)
+{
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+
+namespace {
+
+struct alloc_stat {
+    double count;
+    double bytes;
+};
+
+// heap allocations per call of f(), averaged over n calls
+template <class F>
+alloc_stat measure(F&& f, std::size_t n = 1000)
+{
+    f();    // warm-up (e.g. first-time initialization)
+    std::size_t count = g_alloc_count.load();
+    std::size_t bytes = g_alloc_bytes.load();
+    for (std::size_t i = 0; i < n; ++i) {
+        f();
+    }
+    return {static_cast<double>(g_alloc_count.load() - count) / n,
+            static_cast<double>(g_alloc_bytes.load() - bytes) / n};
+}
+
+void print(const char* name, alloc_stat s)
+{
+    std::printf("%-48s %10.2f %10.1f\n", name, s.count, s.bytes);
+}
+
+// peak resident set size in KiB (0 if unknown)
+long peak_rss_kib()
+{
+#if defined(__APPLE__)
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss / 1024;
+#elif defined(__unix__)
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+tecalc::calculator make_calculator(std::size_t nvars)
+{
+    tecalc::calculator calc;
+    for (std::size_t i = 0; i < nvars; ++i) {
+        calc.bind_var("variable" + std::to_string(i), static_cast<int>(i));
+    }
+    calc.bind_fn("abs", [](int x){ return x < 0 ? -x : x; })
+        .bind_fn("min", [](int a, int b){ return a < b ? a : b; })
+        .bind_fn("max", [](int a, int b){ return a < b ? b : a; });
+    return calc;
+}
+
+} // namespace
+
+
+int main()
+{
+    std::printf("%-48s %10s %10s\n", "operation", "allocs", "bytes");
+
+    // evaluation
+    auto calc = make_calculator(20);
+    const struct { const char* name; const char* expr; } exprs[] = {
+        {"eval/literal", "42"},
+        {"eval/arith", "7 * 3 + 7 / 3 - 7 % 3"},
+        {"eval/variables", "variable1 * variable2 + variable19"},
+        {"eval/call1", "abs(-1)"},
+        {"eval/call2", "min(1, 2) + max(3, 4)"},
+        {"eval/error", "undefined + 1"},
+    };
+    for (const auto& e : exprs) {
+        print(e.name, measure([&]{ calc.try_eval(e.expr); }));
+    }
+    print("eval(expr)/throw", measure([&]{
+        try { calc.eval("undefined"); } catch (const tecalc::tecalc_error&) {}
+    }));
+
+    // binding
+    {
+        const std::string short_name = "x";
+        const std::string long_name = "a_long_variable_name_over_sso";
+        print("bind_var/rebind short name", measure([&]{ calc.bind_var(short_name, 1); }));
+        print("bind_var/rebind long name", measure([&]{ calc.bind_var(long_name, 1); }));
+        tecalc::calculator c;
+        std::size_t i = 0;
+        print("bind_var/new long name", measure([&]{ c.bind_var(long_name + std::to_string(i++), 1); }));
+        print("bind_fn/rebind", measure([&]{ calc.bind_fn("abs", [](int x){ return x; }); }));
+    }
+
+    // construction/copy
+    print("construct (empty)", measure([]{ tecalc::calculator c; (void)c; }));
+    print("construct (20 vars, 3 fns)", measure([]{ auto c = make_calculator(20); (void)c; }, 100));
+    print("copy (20 vars, 3 fns)", measure([&]{ auto c = calc; (void)c; }));
+
+    // memory usage of hosting many calculators
+    constexpr std::size_t kCalcNum = 10000;
+    long rss_before = peak_rss_kib();
+    std::size_t bytes_before = g_alloc_bytes.load();
+    std::vector<tecalc::calculator> calcs;
+    calcs.reserve(kCalcNum);    // includes sizeof(calculator) of each
+    for (std::size_t i = 0; i < kCalcNum; ++i) {
+        calcs.push_back(make_calculator(20));
+    }
+    long rss_after = peak_rss_kib();
+    std::printf("\n%zu calculators (20 vars, 3 fns):\n", kCalcNum);
+    const std::size_t bytes = g_alloc_bytes.load() - bytes_before;
+    std::printf("  allocated  %10zu KiB (%.1f bytes/calculator)\n",
+                bytes / 1024, static_cast<double>(bytes) / kCalcNum);
+    if (rss_after) {
+        std::printf("  peak RSS   %10ld KiB (+%ld KiB)\n", rss_after, rss_after - rss_before);
+    }
+    return 0;
+}
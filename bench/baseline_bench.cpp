@@ -0,0 +1,96 @@
+/*
+ * baseline_bench.cpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// eval API benchmark which also builds with tecalc.hpp of older revisions,
+// compiled twice by baseline_bench.sh. It prints "case<TAB>ns/op" lines only.
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include "tecalc.hpp"
+#include "bench.hpp"
+
+
+namespace {
+
+// try_eval() is not available before eval_result was introduced
+template <class C, class = void>
+struct has_try_eval : std::false_type {};
+template <class C>
+struct has_try_eval<C, std::void_t<decltype(std::declval<C&>().try_eval(std::string_view{}))>> : std::true_type {};
+
+template <class Calculator>
+void bench_cases(Calculator& calc)
+{
+    const std::pair<const char*, std::string> cases[] = {
+        {"literal", "42"},
+        {"arith", "7 * 3 + 7 / 3 - 7 % 3"},
+        {"readme", "(1 + A) * B - 2 + abs(min(-A, -B))"},
+        {"long", "((Width * Height) / (A + B) + 0x2a - 0b1010) * 3 % 1000 + min(Width, Height) - abs(-A * B)"},
+        {"error", "(1 + A) * B - und"},
+    };
+    auto report = [](const std::string& name, const bench::result& r) {
+        std::printf("%s\t%.1f\n", name.c_str(), r.ns_per_op);
+    };
+    for (const auto& [name, expr] : cases) {
+        const std::string suffix = std::string{"/"} + name;
+        std::error_code ec;
+        calc.eval(expr, ec);
+        if (ec && suffix != "/error") {
+            // older revision may not accept the expression
+            std::fprintf(stderr, "skip %s: %s\n", name, ec.message().c_str());
+            continue;
+        }
+        if (suffix != "/error") {
+            report("eval(expr)" + suffix, bench::run("", [&]{
+                bench::do_not_optimize(calc.eval(expr));
+            }));
+        }
+        report("eval(expr, ec)" + suffix, bench::run("", [&]{
+            std::error_code ec;
+            bench::do_not_optimize(calc.eval(expr, ec));
+        }));
+        if constexpr (has_try_eval<Calculator>::value) {
+            report("try_eval(expr)" + suffix, bench::run("", [&]{
+                bench::do_not_optimize(calc.try_eval(expr));
+            }));
+        }
+    }
+}
+
+} // namespace
+
+
+int main()
+{
+    tecalc::calculator calc;
+    calc.bind_var("A", 2).bind_var("B", 4).bind_var("Width", 640).bind_var("Height", 480);
+    calc.bind_fn("abs", [](int x){ return x < 0 ? -x : x; })
+        .bind_fn("min", [](int a, int b){ return a < b ? a : b; });
+    bench_cases(calc);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# baseline_bench.sh -- compare eval API time with tecalc.hpp of other revision
+#
+# usage: baseline_bench.sh REV [CXX [CXXFLAGS...]]
+#   REV is a git revision, e.g. the revision before try_eval() was added;
+#   default CXX is ${CXX:-c++}, default CXXFLAGS is "-O2"
+#
+set -e
+cd "$(dirname "$0")"
+if [ $# -lt 1 ]; then
+  echo "usage: $0 REV [CXX [CXXFLAGS...]]" >&2
+  exit 2
+fi
+REV=$1
+shift
+CXX=${1:-${CXX:-c++}}
+[ $# -gt 0 ] && shift
+FLAGS=${*:--O2}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+mkdir "$OUT/base"
+git show "$REV:include/tecalc.hpp" > "$OUT/base/tecalc.hpp"
+# shellcheck disable=SC2086
+"$CXX" -std=c++17 $FLAGS -I"$OUT/base" baseline_bench.cpp -o "$OUT/base_bench"
+# shellcheck disable=SC2086
+"$CXX" -std=c++17 $FLAGS -I../include baseline_bench.cpp -o "$OUT/head_bench"
+"$OUT/base_bench" > "$OUT/base.txt"
+"$OUT/head_bench" > "$OUT/head.txt"
+
+printf '%-28s %14s %14s %8s\n' case "$REV[ns/op]" current[ns/op] ratio
+awk -F '\t' 'NR == FNR { base[$1] = $2; next }
+     { b = ($1 in base) ? sprintf("%14.1f", base[$1]) : sprintf("%14s", "-");
+       r = ($1 in base) ? sprintf("%8.2f", $2 / base[$1]) : sprintf("%8s", "-");
+       printf "%-28s %s %14.1f %s\n", $1, b, $2, r }' "$OUT/base.txt" "$OUT/head.txt"
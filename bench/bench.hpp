@@ -0,0 +1,133 @@
+/*
+ * bench.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_BENCH_HPP_INCLUDED_
+#define TECALC_BENCH_HPP_INCLUDED_
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include "perf_counters.hpp"
+
+
+namespace bench {
+
+// prevent compiler from optimizing away computation of value
+template <class T>
+inline void do_not_optimize(const T& val)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(val) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &val;
+#endif
+}
+
+// hardware performance counters, enabled by enable_perf()
+inline perf_counters*& perf_instance()
+{
+    static perf_counters* s_perf = nullptr;
+    return s_perf;
+}
+
+// enable hardware performance counters, return false if unavailable
+inline bool enable_perf()
+{
+    static perf_counters s_counters;
+    if (!s_counters.available()) return false;
+    perf_instance() = &s_counters;
+    return true;
+}
+
+struct result {
+    std::string name;
+    std::size_t iterations;
+    double ns_per_op;
+    perf_sample perf;   // (per operation)
+};
+
+// run f() repeatedly at least min_time, and return average time per call
+template <class F>
+result run(std::string name, F&& f,
+           std::chrono::nanoseconds min_time = std::chrono::milliseconds(200))
+{
+    using clock = std::chrono::steady_clock;
+    for (std::size_t i = 0; i < 16; ++i) {
+        f();    // warm-up
+    }
+    perf_counters* perf = perf_instance();
+    std::size_t iters = 1;
+    for (;;) {
+        if (perf) perf->start();
+        auto start = clock::now();
+        for (std::size_t i = 0; i < iters; ++i) {
+            f();
+        }
+        auto elapsed = clock::now() - start;
+        perf_sample sample = perf ? perf->stop(iters) : perf_sample{};
+        if (min_time <= elapsed) {
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+            return {std::move(name), iters, ns / iters, sample};
+        }
+        iters *= 2;
+    }
+}
+
+inline void print_header(const char* title)
+{
+    std::printf("\n## %s\n", title);
+    std::printf("%-48s %14s %12s", "case", "ns/op", "iterations");
+    if (perf_instance()) {
+        std::printf(" %8s %10s %12s %12s", "IPC", "cycles/op", "brmiss/op", "L1dmiss/op");
+    }
+    std::printf("\n");
+}
+
+inline void print(const result& r)
+{
+    std::printf("%-48s %14.1f %12zu", r.name.c_str(), r.ns_per_op, r.iterations);
+    if (perf_instance()) {
+        // unavailable counter is printed as n/a, not as zero
+        auto column = [](int width, int prec, double v) {
+            if (0 <= v) {
+                std::printf(" %*.*f", width, prec, v);
+            } else {
+                std::printf(" %*s", width, "n/a");
+            }
+        };
+        const perf_sample& p = r.perf;
+        column(8, 2, p.valid && 0 < p.cycles && 0 <= p.instructions ? p.instructions / p.cycles : -1);
+        column(10, 1, p.valid ? p.cycles : -1);
+        column(12, 2, p.valid ? p.branch_misses : -1);
+        column(12, 2, p.valid ? p.l1d_misses : -1);
+    }
+    std::printf("\n");
+}
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * benchmark.cpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "tecalc.hpp"
+#include "tecalc_metrics.hpp"
+#include "bench.hpp"
+#include "exprgen.hpp"
+
+
+namespace {
+
+struct expr_case {
+    const char* name;
+    std::string expr;
+};
+
+template <class Calculator = tecalc::calculator>
+Calculator make_calculator()
+{
+    Calculator calc;
+    calc.bind_var("A", 2).bind_var("B", 4).bind_var("Width", 640).bind_var("Height", 480);
+    calc.bind_fn("abs", [](int x){ return x < 0 ? -x : x; })
+        .bind_fn("min", [](int a, int b){ return a < b ? a : b; });
+    return calc;
+}
+
+// tecalc::calculator API variations
+void bench_eval_api(const expr_case& c)
+{
+    auto calc = make_calculator();
+    bench::print(bench::run(std::string{"eval(expr)/"} + c.name, [&]{
+        bench::do_not_optimize(calc.eval(c.expr));
+    }));
+    bench::print(bench::run(std::string{"eval(expr, ec)/"} + c.name, [&]{
+        std::error_code ec;
+        bench::do_not_optimize(calc.eval(c.expr, ec));
+    }));
+    bench::print(bench::run(std::string{"try_eval(expr)/"} + c.name, [&]{
+        bench::do_not_optimize(calc.try_eval(c.expr));
+    }));
+}
+
+const expr_case cases[] = {
+    {"literal", "42"},
+    {"arith", "7 * 3 + 7 / 3 - 7 % 3"},
+    {"readme", "(1 + A) * B - 2 + abs(min(-A, -B))"},
+    {"long", "((Width * Height) / (A + B) + 0x2a - 0b1010) * 3 % 1000 + min(Width, Height) - abs(-A * B)"},
+};
+
+void bench_api()
+{
+    bench::print_header("eval API");
+    for (const auto& c : cases) {
+        bench_eval_api(c);
+    }
+
+    const std::string error_expr = "(1 + A) * B - und";
+    bench::print_header("error path");
+    auto calc = make_calculator();
+    bench::print(bench::run("eval(expr, ec)/error", [&]{
+        std::error_code ec;
+        bench::do_not_optimize(calc.eval(error_expr, ec));
+    }));
+    bench::print(bench::run("try_eval(expr)/error", [&]{
+        bench::do_not_optimize(calc.try_eval(error_expr));
+    }));
+}
+
+void bench_tracing()
+{
+    bench::print_header("tracing policy");
+    auto calc = make_calculator();
+    auto metrics_calc = make_calculator<tecalc::basic_calculator<int, 2, tecalc::metrics_tracer>>();
+    for (const auto& c : cases) {
+        bench::print(bench::run(std::string{"null_tracer/"} + c.name, [&]{
+            bench::do_not_optimize(calc.try_eval(c.expr));
+        }));
+        bench::print(bench::run(std::string{"metrics_tracer/"} + c.name, [&]{
+            bench::do_not_optimize(metrics_calc.try_eval(c.expr));
+        }));
+    }
+}
+
+// scalability by expression size and symbol table size, with generated expressions
+void bench_scaling()
+{
+    using calculator = tecalc::basic_calculator<unsigned>;
+    auto run_expr = [](const std::string& label, const bench::exprgen_config& cfg) {
+        calculator calc;
+        bench::expr_generator::bind(calc, cfg.var_count);
+        const std::string expr = bench::expr_generator{cfg}.generate();
+        if (auto res = calc.try_eval(expr); !res) {
+            std::printf("%s: generated expression failed (errc=%d)\n", label.c_str(), static_cast<int>(res.ec));
+            return;
+        }
+        auto r = bench::run(label, [&]{
+            bench::do_not_optimize(calc.try_eval(expr));
+        });
+        bench::print(r);
+        std::printf("%-48s %14.2f ns/byte (%zu bytes)\n", "", r.ns_per_op / expr.size(), expr.size());
+    };
+
+    bench::print_header("scaling by expression size");
+    for (std::size_t size : {10, 100, 1000, 10000, 100000}) {
+        bench::exprgen_config cfg;
+        cfg.size = size;
+        cfg.var_count = 100;
+        cfg.var_percent = 30;
+        cfg.call_percent = 5;
+        run_expr("size=" + std::to_string(size), cfg);
+    }
+
+    bench::print_header("scaling by number of variables");
+    for (std::size_t vars : {10, 100, 1000, 10000, 100000}) {
+        bench::exprgen_config cfg;
+        cfg.size = 100;
+        cfg.var_count = vars;
+        cfg.var_percent = 80;
+        cfg.paren_percent = 0;
+        run_expr("vars=" + std::to_string(vars), cfg);
+    }
+
+    bench::print_header("scaling by function call density");
+    for (unsigned percent : {0, 10, 30, 50}) {
+        bench::exprgen_config cfg;
+        cfg.size = 100;
+        cfg.call_percent = percent;
+        run_expr("call=" + std::to_string(percent) + "%", cfg);
+    }
+
+    bench::print_header("literal radix");
+    const struct { const char* name; unsigned w_dec, w_hex, w_bin; } radixes[] = {
+        {"dec", 1, 0, 0}, {"hex", 0, 1, 0}, {"bin", 0, 0, 1},
+    };
+    for (const auto& r : radixes) {
+        bench::exprgen_config cfg;
+        cfg.size = 100;
+        cfg.w_dec = r.w_dec;
+        cfg.w_hex = r.w_hex;
+        cfg.w_bin = r.w_bin;
+        run_expr(std::string{"radix="} + r.name, cfg);
+    }
+}
+
+// run worker(thread_index) on nthreads threads simultaneously, and return elapsed seconds
+template <class Worker>
+double run_threads(int nthreads, Worker worker)
+{
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nthreads; ++i) {
+        threads.emplace_back([&, i]{
+            ++ready;
+            while (!go.load(std::memory_order_acquire))
+                ;
+            worker(i);
+        });
+    }
+    while (ready.load() != nthreads)
+        ;
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads) {
+        t.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// calculator padded to its own cache lines
+struct alignas(64) padded_calculator {
+    tecalc::calculator calc = make_calculator();
+};
+
+// aggregate throughput with 1..N threads
+//   per-thread: each thread constructs its own calculator
+//   copy-shared: each thread copies one shared (const) calculator
+//   packed: per-thread calculators are adjacent in one array (false sharing)
+//   padded: per-thread calculators are aligned to cache line
+//   mutex-shared: all threads share one calculator guarded by mutex
+// Note that one calculator cannot evaluate concurrently, since eval() updates
+// its parsing state.
+void bench_threads()
+{
+    const std::string expr = cases[2].expr;
+    constexpr std::size_t kIters = 200000;
+    // TECALC_BENCH_THREADS environment variable overrides max number of threads
+    const char* env = std::getenv("TECALC_BENCH_THREADS");
+    const int max_threads = env ? std::max(1, std::atoi(env))
+                                : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<int> nthreads_list;
+    for (int n = 1; n < max_threads; n *= 2) {
+        nthreads_list.push_back(n);
+    }
+    nthreads_list.push_back(max_threads);
+
+    const auto shared = make_calculator();
+    std::mutex mtx;
+    auto mutex_calc = make_calculator();
+    using worker_factory = std::function<std::function<void(int)>(int)>;
+    const std::pair<const char*, worker_factory> strategies[] = {
+        {"per-thread", [&](int) {
+            return [&](int) {
+                auto calc = make_calculator();
+                for (std::size_t i = 0; i < kIters; ++i) bench::do_not_optimize(calc.try_eval(expr));
+            };
+        }},
+        {"copy-shared", [&](int) {
+            return [&](int) {
+                auto calc = shared;
+                for (std::size_t i = 0; i < kIters; ++i) bench::do_not_optimize(calc.try_eval(expr));
+            };
+        }},
+        {"packed", [&](int n) {
+            auto calcs = std::make_shared<std::vector<tecalc::calculator>>(n, shared);
+            return [&, calcs](int t) {
+                auto& calc = (*calcs)[t];
+                for (std::size_t i = 0; i < kIters; ++i) bench::do_not_optimize(calc.try_eval(expr));
+            };
+        }},
+        {"padded", [&](int n) {
+            auto calcs = std::make_shared<std::vector<padded_calculator>>(n);
+            return [&, calcs](int t) {
+                auto& calc = (*calcs)[t].calc;
+                for (std::size_t i = 0; i < kIters; ++i) bench::do_not_optimize(calc.try_eval(expr));
+            };
+        }},
+        {"mutex-shared", [&](int) {
+            return [&](int) {
+                for (std::size_t i = 0; i < kIters; ++i) {
+                    std::lock_guard<std::mutex> lk{mtx};
+                    bench::do_not_optimize(mutex_calc.try_eval(expr));
+                }
+            };
+        }},
+    };
+
+    std::printf("\n## thread scaling (%zu evaluations per thread)\n", kIters);
+    std::printf("%-16s %8s %14s %12s\n", "strategy", "threads", "Meval/s", "efficiency");
+    for (const auto& [name, factory] : strategies) {
+        double base = 0.0;
+        for (int n : nthreads_list) {
+            auto worker = factory(n);
+            double sec = run_threads(n, worker);
+            double throughput = static_cast<double>(kIters) * n / sec;
+            if (n == 1) base = throughput;
+            std::printf("%-16s %8d %14.2f %11.1f%%\n", name, n, throughput * 1e-6,
+                        100.0 * throughput / (base * n));
+        }
+    }
+}
+
+} // namespace
+
+
+// usage: benchmark [--perf] [SECTION...]
+//   --perf  := report hardware performance counters (Linux only)
+//   SECTION := api | tracing | scaling | threads (all sections if not specified)
+int main(int argc, char* argv[])
+{
+    if (1 < argc && std::strcmp(argv[1], "--perf") == 0) {
+        if (!bench::enable_perf()) {
+            std::fprintf(stderr, "warning: hardware performance counters are not available\n");
+        }
+        --argc;
+        ++argv;
+    }
+    const std::pair<const char*, void(*)()> sections[] = {
+        {"api", bench_api},
+        {"tracing", bench_tracing},
+        {"scaling", bench_scaling},
+        {"threads", bench_threads},
+    };
+    for (const auto& [name, func] : sections) {
+        bool selected = (argc <= 1);
+        for (int i = 1; i < argc; ++i) {
+            selected |= (std::strcmp(argv[i], name) == 0);
+        }
+        if (selected) {
+            func();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * compile_bench.cpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "tecalc.hpp"
+
+// translation unit for compile_bench.sh, which compiles this file
+// with various TECALC_BENCH_VALUE and TECALC_BENCH_ARGS.
+#ifndef TECALC_BENCH_VALUE
+#define TECALC_BENCH_VALUE int
+#endif
+#ifndef TECALC_BENCH_ARGS
+#define TECALC_BENCH_ARGS 2
+#endif
+
+using value_type = TECALC_BENCH_VALUE;
+using calculator = tecalc::basic_calculator<value_type, TECALC_BENCH_ARGS>;
+
+value_type compile_bench(const char* expr, value_type x, value_type (*fn)())
+{
+    calculator calc;
+    calc.bind_var("x", x);
+    calc.bind_fn("f", fn);
+    return calc.eval(expr);
+}
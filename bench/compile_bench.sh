@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# compile_bench.sh -- build time and object size of basic_calculator<Value, N>
+#
+# usage: compile_bench.sh [CXX [CXXFLAGS...]]
+#   default CXX is ${CXX:-c++}, default CXXFLAGS is "-O2"
+#
+set -e
+cd "$(dirname "$0")"
+CXX=${1:-${CXX:-c++}}
+[ $# -gt 0 ] && shift
+FLAGS=${*:--O2}
+VALUES=${TECALC_BENCH_VALUES:-"int long_long unsigned"}
+ARGS=${TECALC_BENCH_ARGS:-"2 4 8 16"}
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+# run command and print its wall time in milliseconds
+#   date +%N is a GNU extension, so use python3 or fall back to seconds.
+if command -v python3 > /dev/null 2>&1; then
+  time_ms() {
+    python3 -c 'import subprocess, sys, time
+t = time.monotonic()
+subprocess.check_call(sys.argv[1:])
+print(int((time.monotonic() - t) * 1000))' "$@"
+  }
+else
+  time_ms() { t0=$(date +%s); "$@"; echo $((($(date +%s) - t0) * 1000)); }
+fi
+
+printf '%-10s %4s %10s %10s %10s\n' value N time[ms] text[B] object[B]
+for v in $VALUES; do
+  for n in $ARGS; do
+    obj="$OUT/$v-$n.o"
+    # shellcheck disable=SC2086
+    ms=$(time_ms "$CXX" -std=c++17 $FLAGS -I../include "-DTECALC_BENCH_VALUE=$(echo "$v" | tr _ ' ')" \
+      "-DTECALC_BENCH_ARGS=$n" -c compile_bench.cpp -o "$obj")
+    text=$(size "$obj" 2>/dev/null | awk 'NR == 2 { print $1 }')
+    printf '%-10s %4d %10d %10s %10d\n' "$v" "$n" "$ms" "${text:--}" "$(wc -c < "$obj")"
+  done
+done
@@ -0,0 +1,181 @@
+/*
+ * exprgen.hpp -- random expression generator
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_EXPRGEN_HPP_INCLUDED_
+#define TECALC_EXPRGEN_HPP_INCLUDED_
+
+#include <cstdint>
+#include <string>
+
+
+namespace bench {
+
+//
+// random expression generator
+//
+// Generated expressions follow tecalc grammar, and use variables "v0".."v<N-1>"
+// and functions "f1"(unary), "f2"(binary). Divisor of '/' and '%' is always
+// non-zero literal, but other operations may overflow, so evaluate them with
+// unsigned value type to keep results well-defined.
+//
+struct exprgen_config {
+    std::uint64_t seed = 1;
+    std::size_t size = 100;         // number of operands in top-level expression
+    int max_depth = 4;              // max nesting of parentheses/function calls
+    std::size_t nested_size = 3;    // max number of operands in nested expression
+    // operator mix (relative weights)
+    unsigned w_add = 4, w_sub = 3, w_mul = 2, w_div = 1, w_mod = 1;
+    // literal radix mix (relative weights)
+    unsigned w_dec = 8, w_hex = 1, w_bin = 1;
+    std::size_t var_count = 0;      // number of variables
+    // operand kind probabilities in percent (rest are literals)
+    unsigned var_percent = 0;
+    unsigned call_percent = 0;
+    unsigned paren_percent = 10;
+    unsigned unary_percent = 10;    // probability of unary '-' prefix
+};
+
+class expr_generator {
+public:
+    explicit expr_generator(const exprgen_config& cfg)
+        : cfg_{cfg}, state_{cfg.seed} {}
+
+    std::string generate()
+    {
+        std::string out;
+        gen_expr(out, cfg_.size, 0);
+        return out;
+    }
+
+    // bind variables and functions which generated expressions use
+    template <class Calculator>
+    static void bind(Calculator& calc, std::size_t var_count)
+    {
+        using value_type = typename Calculator::value_type;
+        for (std::size_t i = 0; i < var_count; ++i) {
+            calc.bind_var("v" + std::to_string(i), static_cast<value_type>(i + 1));
+        }
+        calc.bind_fn("f1", [](value_type x){ return x * 3 + 1; })
+            .bind_fn("f2", [](value_type x, value_type y){ return x ^ y; });
+    }
+
+private:
+    // splitmix64, which gives same sequence on any platform
+    std::uint64_t next() noexcept
+    {
+        std::uint64_t z = (state_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    std::uint64_t uniform(std::uint64_t n) noexcept { return n ? next() % n : 0; }
+    bool chance(unsigned percent) noexcept { return uniform(100) < percent; }
+
+    char pick_op()
+    {
+        const unsigned w[] = {cfg_.w_add, cfg_.w_sub, cfg_.w_mul, cfg_.w_div, cfg_.w_mod};
+        const char ops[] = {'+', '-', '*', '/', '%'};
+        unsigned total = 0;
+        for (unsigned x : w) total += x;
+        auto r = uniform(total ? total : 1);
+        for (int i = 0; i < 5; ++i) {
+            if (r < w[i]) return ops[i];
+            r -= w[i];
+        }
+        return '+';
+    }
+
+    void gen_literal(std::string& out, bool nonzero)
+    {
+        std::uint64_t v = nonzero ? 1 + uniform(99) : uniform(100);
+        unsigned total = cfg_.w_dec + cfg_.w_hex + cfg_.w_bin;
+        auto r = uniform(total ? total : 1);
+        if (r < cfg_.w_dec || total == 0) {
+            out += std::to_string(v);
+            return;
+        }
+        const bool hex = r < cfg_.w_dec + cfg_.w_hex;
+        out += hex ? "0x" : "0b";
+        const int bits = hex ? 4 : 1;
+        int shift = 0;
+        while ((v >> shift) >> bits) shift += bits;
+        for (; 0 <= shift; shift -= bits) {
+            out += "0123456789abcdef"[(v >> shift) & ((1u << bits) - 1)];
+        }
+    }
+
+    void gen_operand(std::string& out, int depth)
+    {
+        if (chance(cfg_.unary_percent)) {
+            out += '-';
+        }
+        const bool nestable = depth < cfg_.max_depth;
+        auto r = uniform(100);
+        if (r < cfg_.var_percent && cfg_.var_count) {
+            out += 'v';
+            out += std::to_string(uniform(cfg_.var_count));
+        } else if ((r -= cfg_.var_percent) < cfg_.call_percent && nestable) {
+            if (chance(50)) {
+                out += "f1(";
+                gen_expr(out, 1 + uniform(cfg_.nested_size), depth + 1);
+            } else {
+                out += "f2(";
+                gen_expr(out, 1 + uniform(cfg_.nested_size), depth + 1);
+                out += ", ";
+                gen_expr(out, 1 + uniform(cfg_.nested_size), depth + 1);
+            }
+            out += ')';
+        } else if ((r -= cfg_.call_percent) < cfg_.paren_percent && nestable) {
+            out += '(';
+            gen_expr(out, 1 + uniform(cfg_.nested_size), depth + 1);
+            out += ')';
+        } else {
+            gen_literal(out, false);
+        }
+    }
+
+    void gen_expr(std::string& out, std::size_t n, int depth)
+    {
+        gen_operand(out, depth);
+        for (std::size_t i = 1; i < n; ++i) {
+            char op = pick_op();
+            out += ' ';
+            out += op;
+            out += ' ';
+            if (op == '/' || op == '%') {
+                gen_literal(out, true);
+            } else {
+                gen_operand(out, depth);
+            }
+        }
+    }
+
+    exprgen_config cfg_;
+    std::uint64_t state_;
+};
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * perf_counters.hpp -- hardware performance counters (Linux perf_event)
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_PERF_COUNTERS_HPP_INCLUDED_
+#define TECALC_PERF_COUNTERS_HPP_INCLUDED_
+
+#include <cstdint>
+
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+namespace bench {
+
+// hardware event counts (each count is negative if the counter is unavailable)
+struct perf_sample {
+    bool valid = false;
+    double cycles = -1;
+    double instructions = -1;
+    double branch_misses = -1;
+    double l1d_misses = -1;     // L1 data cache read misses
+};
+
+//
+// hardware performance counters
+//
+// Counters are opened as one event group of calling thread. On non-Linux
+// platform, or when perf_event_open(2) is not permitted (see
+// /proc/sys/kernel/perf_event_paranoid), available() returns false.
+//
+class perf_counters {
+public:
+    enum { kCycles, kInstructions, kBranchMisses, kL1dMisses, kEventNum };
+
+    perf_counters()
+    {
+#if defined(__linux__)
+        const std::uint32_t types[kEventNum] = {
+            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        };
+        const std::uint64_t configs[kEventNum] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_BRANCH_MISSES,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        };
+        for (int i = 0; i < kEventNum; ++i) {
+            perf_event_attr pe;
+            std::memset(&pe, 0, sizeof(pe));
+            pe.type = types[i];
+            pe.size = sizeof(pe);
+            pe.config = configs[i];
+            pe.disabled = (leader_ < 0);
+            pe.exclude_kernel = 1;
+            pe.exclude_hv = 1;
+            pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &pe, 0, -1, leader_, 0));
+            if (fd < 0) {
+                // cycles/instructions are mandatory, others are optional
+                if (i <= kInstructions) {
+                    close_all();
+                    return;
+                }
+                continue;
+            }
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids_[i]);
+            fds_[i] = fd;
+            if (leader_ < 0) leader_ = fd;
+        }
+#endif
+    }
+    ~perf_counters() { close_all(); }
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const noexcept { return leader_ >= 0; }
+
+    void start() noexcept
+    {
+#if defined(__linux__)
+        if (leader_ < 0) return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // stop counting, and return counts divided by n
+    perf_sample stop(std::uint64_t n = 1) noexcept
+    {
+        perf_sample s;
+#if defined(__linux__)
+        if (leader_ < 0) return s;
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // {nr, {value, id}[nr]}
+        std::uint64_t buf[1 + 2 * kEventNum];
+        if (read(leader_, buf, sizeof(buf)) <= 0) return s;
+        // counter which failed to open, or is missing in group, is unavailable
+        double values[kEventNum] = {-1.0 * n, -1.0 * n, -1.0 * n, -1.0 * n};
+        for (std::uint64_t k = 0; k < buf[0]; ++k) {
+            for (int i = 0; i < kEventNum; ++i) {
+                if (fds_[i] >= 0 && ids_[i] == buf[2 + 2 * k]) {
+                    values[i] = static_cast<double>(buf[1 + 2 * k]);
+                }
+            }
+        }
+        s.valid = true;
+        s.cycles = values[kCycles] / n;
+        s.instructions = values[kInstructions] / n;
+        s.branch_misses = values[kBranchMisses] / n;
+        s.l1d_misses = values[kL1dMisses] / n;
+#else
+        (void)n;
+#endif
+        return s;
+    }
+
+private:
+    void close_all() noexcept
+    {
+#if defined(__linux__)
+        for (int& fd : fds_) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+#endif
+        leader_ = -1;
+    }
+
+    int leader_ = -1;
+    int fds_[kEventNum] = {-1, -1, -1, -1};
+    std::uint64_t ids_[kEventNum] = {};
+};
+
+} // namespace bench
+
+#endif
@@ -28,12 +28,33 @@
 
 #include <algorithm>
 #include <charconv>
+#include <cmath>
+#include <cstdint>
 #include <map>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <system_error>
-#include <variant>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+// compiler hints for separating error handling (cold path) from evaluation (hot path)
+#if defined(__GNUC__) || defined(__clang__)
+#define TECALC_LIKELY(x)    __builtin_expect(!!(x), 1)
+#define TECALC_UNLIKELY(x)  __builtin_expect(!!(x), 0)
+#define TECALC_COLD         __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+#define TECALC_LIKELY(x)    (x)
+#define TECALC_UNLIKELY(x)  (x)
+#define TECALC_COLD         __declspec(noinline)
+#else
+#define TECALC_LIKELY(x)    (x)
+#define TECALC_UNLIKELY(x)  (x)
+#define TECALC_COLD
+#endif
 
 
 namespace tecalc {
@@ -47,6 +68,17 @@ enum class errc {
     unknown_identifier,
     arg_num_mismatch,
     divide_by_zero,
+    function_error,
+};
+
+//
+// evaluation result
+//
+template <class Value>
+struct eval_result {
+    Value value{};      // evaluated value (valid only if ec is unset)
+    errc ec{};          // error code, or errc{} on success
+    explicit operator bool() const noexcept { return ec == errc{}; }
 };
 
 namespace impl {
@@ -59,10 +91,25 @@ inline const char* errc2msg(errc ev) noexcept
     case errc::unknown_identifier: return "Unknown identifier";
     case errc::arg_num_mismatch: return "Argument number mismatch";
     case errc::divide_by_zero: return "Divide by zero";
+    case errc::function_error: return "Function error";
     }
     return "Unknown tecalc::errc";
 }
 
+// "<message> at offset <pos>" (and " (length <len>)" if error token is known)
+inline std::string errloc2msg(errc ev, std::size_t pos, std::size_t len)
+{
+    std::string msg = errc2msg(ev);
+    msg += " at offset ";
+    msg += std::to_string(pos);
+    if (len) {
+        msg += " (length ";
+        msg += std::to_string(len);
+        msg += ')';
+    }
+    return msg;
+}
+
 class tecalc_error_category : public std::error_category {
 public:
     const char* name() const noexcept override
@@ -73,65 +120,111 @@ public:
 
 //
 // meta functions
+//   Every metafunction expands a parameter pack over std::make_index_sequence
+//   instead of recursing on MaxArgNum, so instantiation depth stays constant.
 //
-template<class...> struct typelist {};
-
-// repeat<T, N> := typelist<T_n...>
-template<class, class> struct repeat_helper {};
-template<class T, class... Ts>
-struct repeat_helper<T, typelist<Ts...>> { using type = typelist<Ts..., T>; };
-template<class T, int N>
-struct repeat {
-    using type = typename repeat_helper<T, typename repeat<T, N-1>::type>::type;
-};
-template<class T>
-struct repeat<T, 0> { using type = typelist<>; };
+template<class T, size_t> using always_t = T;
 
-// funcptr<T, N> := T(*)(T_1, ...T_n)
-template<class R, class... Ts>
-auto funcptr_helper(typelist<Ts...>) -> R(*)(Ts...);
-template<class T, int N>
+// funcptr<T, N, R> := R(*)(T_1, ...T_n)
+template<class R, class T, size_t... Is>
+auto funcptr_helper(std::index_sequence<Is...>) -> R(*)(always_t<T, Is>...);
+template<class T, int N, class R = T>
 struct funcptr {
-    using args_typelist = typename repeat<T, N>::type;
-    using type = decltype(funcptr_helper<T>(std::declval<args_typelist>()));
+    using type = decltype(funcptr_helper<R, T>(std::make_index_sequence<N>{}));
+};
+
+// fnptr_variant<Fs...> := tagged union of function pointer types Fs...
+//   A std::variant replacement for function pointers only. Each alternative
+//   is stored as erased_fnptr and converted back to Fs[index()] by invoker,
+//   which is well-defined round-trip conversion of function pointers.
+//   The alternative is selected by a flat overload set, so that neither
+//   construction nor invocation instantiates templates recursively.
+using erased_fnptr = void(*)();
+template<size_t I, class F>
+struct fnptr_alt {
+    static constexpr size_t index = I;
+    using type = F;
+    static fnptr_alt select(F) noexcept;
+};
+template<class, class...> struct fnptr_selector;
+template<size_t... Is, class... Fs>
+struct fnptr_selector<std::index_sequence<Is...>, Fs...> : fnptr_alt<Is, Fs>... {
+    using fnptr_alt<Is, Fs>::select...;
+};
+template<class... Fs>
+class fnptr_variant {
+    using selector = fnptr_selector<std::index_sequence_for<Fs...>, Fs...>;
+    template<class F>
+    using select_t = decltype(selector::select(std::declval<F>()));
+
+public:
+    static constexpr size_t size = sizeof...(Fs);
+
+    // null pointer of first alternative, like std::variant
+    fnptr_variant() noexcept : ptr_(nullptr), index_(0) {}
+
+    template<class F, class Alt = select_t<F>>
+    fnptr_variant(F&& f) noexcept
+        : ptr_(reinterpret_cast<erased_fnptr>(static_cast<typename Alt::type>(f))), index_(Alt::index) {}
+
+    size_t index() const noexcept { return index_; }
+    erased_fnptr ptr() const noexcept { return ptr_; }
+
+    // stored pointer if F is the current alternative, otherwise nullptr
+    //   replaces std::get_if on func_type of former std::variant
+    template<class F, class Alt = decltype(selector::select(std::declval<F>()))>
+    F target() const noexcept
+    {
+        static_assert(std::is_same_v<typename Alt::type, F>, "F must be an alternative");
+        return index_ == Alt::index ? reinterpret_cast<F>(ptr_) : nullptr;
+    }
+
+private:
+    erased_fnptr ptr_;
+    size_t index_;
 };
 
-// func_variant<T, N> := std::variant<T(*)(), T(*)(T_1), ...T(*)(T_1, ...T_n)>
-template<class, class> struct func_variant_helper {};
-template<class T, class... Ts>
-struct func_variant_helper<T, std::variant<Ts...>> { using type = std::variant<Ts..., T>; };
-template<class T, int N>
+// func_variant<T, N, R> := fnptr_variant<R(*)(), R(*)(T_1), ...R(*)(T_1, ...T_n)>
+template<class T, class R, size_t... Ns>
+auto func_variant_helper(std::index_sequence<Ns...>)
+    -> fnptr_variant<typename funcptr<T, static_cast<int>(Ns), R>::type...>;
+template<class T, int N, class R = T>
 struct func_variant {
-    using type = typename func_variant_helper<
-        typename funcptr<T, N>::type, typename func_variant<T, N-1>::type>::type;
+    using type = decltype(func_variant_helper<T, R>(std::make_index_sequence<N + 1>{}));
 };
-template<class T>
-struct func_variant<T, 0> { using type = std::variant<typename funcptr<T, 0>::type>; };
 
-// invoker<Value, F, MaxArgNum>::invoke(f, arg) := std::get<M>(f)(arg[0], ...T_m)
-template <class Value, class F, size_t... Is>
-inline Value invoke_f(F f, const std::vector<Value>& args, std::index_sequence<Is...>)
-{
-    return f(args[Is]...);
-}
-template <class Value, class FnType, size_t N>
-struct invoker {
-    static inline Value invoke(FnType& fn, const std::vector<Value>& args)
+// variant_cat<fnptr_variant<Fs...>, fnptr_variant<Gs...>> := fnptr_variant<Fs..., Gs...>
+template<class, class> struct variant_cat {};
+template<class... Fs, class... Gs>
+struct variant_cat<fnptr_variant<Fs...>, fnptr_variant<Gs...>> { using type = fnptr_variant<Fs..., Gs...>; };
+
+// invoker<FnType>::invoke<Value>(fn, args) := eval_result<Value>{Fs[I](args[0], ...args[m-1])}
+//   where I == fn.index(), m == arity of Fs[I]
+//   dispatches with a table of function pointers indexed by fn.index().
+//   Each table entry depends only on its own function type and Value.
+template<class F> struct fnptr_call;
+template<class R, class... Ts>
+struct fnptr_call<R(*)(Ts...)> {
+    template <class Value, size_t... Is>
+    static eval_result<Value> invoke_f(erased_fnptr ptr, const Value* args, std::index_sequence<Is...>)
     {
-        if (args.size() == N) {
-            return invoke_f(std::get<N>(fn), args, std::make_index_sequence<N>{});
-        }
-        return invoker<Value, FnType, N-1>::invoke(fn, args);
+        return {reinterpret_cast<R(*)(Ts...)>(ptr)(args[Is]...)};
+    }
+    template <class Value>
+    static eval_result<Value> invoke(erased_fnptr ptr, const Value* args)
+    {
+        return invoke_f(ptr, args, std::index_sequence_for<Ts...>{});
     }
 };
-template <class Value, class FnType>
-struct invoker<Value, FnType, 0> {
-    static inline Value invoke(FnType& fn, const std::vector<Value>& args)
+template<class FnType> struct invoker;
+template<class... Fs>
+struct invoker<fnptr_variant<Fs...>> {
+    template <class Value>
+    static eval_result<Value> invoke(const fnptr_variant<Fs...>& fn, const std::vector<Value>& args)
     {
-        if (args.size() == 0) {
-            return (std::get<0>(fn))();
-        }
-        return {}; // not reachable
+        using thunk_type = eval_result<Value> (*)(erased_fnptr, const Value*);
+        static constexpr thunk_type table[] = { &fnptr_call<Fs>::template invoke<Value>... };
+        return table[fn.index()](fn.ptr(), args.data());
     }
 };
 
@@ -146,16 +239,36 @@ inline const std::error_category& tecalc_category() noexcept
     return s_category;
 }
 
+// found by argument-dependent lookup from std::error_code(errc)
+inline std::error_code make_error_code(errc e) noexcept
+{
+    return std::error_code(static_cast<int>(e), tecalc_category());
+}
+
+//
+// error location in input expression
+//
+struct error_location {
+    std::size_t offset = 0;     // offset from the beginning of expression
+    std::size_t length = 0;     // length of erroneous token (0 if unknown)
+};
+
 //
 // error class
 //
 class tecalc_error : public std::runtime_error {
     std::error_code ec_;
+    error_location loc_;
 public:
     tecalc_error(errc ev)
         : std::runtime_error{impl::errc2msg(ev)}
         , ec_{static_cast<int>(ev), tecalc::tecalc_category()} {}
+    tecalc_error(errc ev, error_location loc)
+        : std::runtime_error{impl::errloc2msg(ev, loc.offset, loc.length)}
+        , ec_{static_cast<int>(ev), tecalc::tecalc_category()}
+        , loc_{loc} {}
     const std::error_code& code() const noexcept { return ec_; }
+    const error_location& location() const noexcept { return loc_; }
 };
 
 } // namespace tecalc
@@ -166,9 +279,10 @@ namespace std {
 template <>
 struct is_error_code_enum<tecalc::errc> : public true_type {};
 
-error_code make_error_code(tecalc::errc e) noexcept
+// for compatibility; prefer tecalc::make_error_code
+inline error_code make_error_code(tecalc::errc e) noexcept
 {
-    return error_code(static_cast<int>(e), tecalc::tecalc_category());
+    return tecalc::make_error_code(e);
 }
 
 } // namespace std
@@ -176,35 +290,257 @@ error_code make_error_code(tecalc::errc e) noexcept
 
 namespace tecalc {
 
+#if defined(__SIZEOF_INT128__)
+// 128-bit integer types (GCC/Clang extension), which can be used as Value
+#define TECALC_HAS_INT128 1
+__extension__ typedef __int128 int128_t;
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+namespace impl {
+
+// integer types including 128-bit integers, which are not integral types
+// in strict ISO C++ mode (-std=c++17)
+template <class T>
+constexpr bool is_integer_v = std::is_integral_v<T>
+#if defined(TECALC_HAS_INT128)
+    || std::is_same_v<T, int128_t> || std::is_same_v<T, uint128_t>
+#endif
+    ;
+
+inline int digit_value(char x) noexcept
+{
+    if ('0' <= x && x <= '9') return x - '0';
+    if ('a' <= x && x <= 'z') return x - 'a' + 10;
+    if ('A' <= x && x <= 'Z') return x - 'A' + 10;
+    return -1;
+}
+
+// parse digits of base into 128-bit integer, return nullptr on overflow
+//   Leading digits are accumulated in 64-bit integer, which avoids slow
+//   128-bit multiplication for most literals.
+#if defined(TECALC_HAS_INT128)
+template <class T>
+const char* parse_int128(const char* first, const char* last, int base, T& val) noexcept
+{
+    // std::make_unsigned and std::is_signed do not support them in strict mode
+    using U = uint128_t;
+    const int fast_digits = (base == 10) ? 19 : (base == 16) ? 15 : 63;
+    std::uint64_t head = 0;
+    const char* p = first;
+    for (; p != last && p - first < fast_digits; ++p) {
+        int d = digit_value(*p);
+        if (d < 0 || base <= d) break;
+        head = head * static_cast<unsigned>(base) + static_cast<unsigned>(d);
+    }
+    U acc = head;
+    const U max = std::is_same_v<T, int128_t> ? (~U{0} >> 1) : ~U{0};
+    const U limit = max / static_cast<unsigned>(base);
+    const unsigned max_digit = static_cast<unsigned>(max % static_cast<unsigned>(base));
+    for (; p != last; ++p) {
+        int d = digit_value(*p);
+        if (d < 0 || base <= d) break;
+        if (limit < acc || (acc == limit && max_digit < static_cast<unsigned>(d))) return nullptr;
+        acc = acc * static_cast<unsigned>(base) + static_cast<unsigned>(d);
+    }
+    val = static_cast<T>(acc);
+    return p;
+}
+#endif
+
+} // namespace impl
+
+//
+// value traits
+//
+// Customization point of number literal and division for Value type.
+// Primary template supports integer (including 128-bit) and floating-point
+// types, and user-defined value type may specialize it.
+//
+template <class Value>
+struct value_traits {
+    // parse digits of base (2, 10, 16) from [first, last) into val,
+    // return end of parsed literal, or nullptr if no digit or out of range
+    static const char* parse_literal(const char* first, const char* last, int base, Value& val) noexcept
+    {
+        if (first == last || impl::digit_value(*first) < 0 || base <= impl::digit_value(*first)) {
+            return nullptr;
+        }
+        if constexpr (std::is_integral_v<Value> && sizeof(Value) <= sizeof(long long)) {
+            auto r = std::from_chars(first, last, val, base);
+            return r.ec == std::errc{} ? r.ptr : nullptr;
+#if defined(TECALC_HAS_INT128)
+        } else if constexpr (impl::is_integer_v<Value>) {
+            return impl::parse_int128(first, last, base, val);
+#endif
+        } else {
+            // floating-point std::from_chars does not take base
+            val = 0;
+            for (; first != last; ++first) {
+                int d = impl::digit_value(*first);
+                if (d < 0 || base <= d) break;
+                val = val * base + d;
+            }
+            return first;
+        }
+    }
+
+    // lhs / rhs for non-zero rhs
+    static Value divide(const Value& lhs, const Value& rhs) noexcept
+    {
+#if defined(TECALC_HAS_INT128)
+        if constexpr (std::is_same_v<Value, int128_t>) {
+            // 128-bit division is a library call, so divide small operands
+            // by 64-bit instruction (except overflowing INT64_MIN / -1)
+            if (fits_int64(lhs) && fits_int64(rhs) && rhs != -1) {
+                return static_cast<std::int64_t>(lhs) / static_cast<std::int64_t>(rhs);
+            }
+        } else if constexpr (std::is_same_v<Value, uint128_t>) {
+            if ((lhs >> 64) == 0 && (rhs >> 64) == 0) {
+                return static_cast<std::uint64_t>(lhs) / static_cast<std::uint64_t>(rhs);
+            }
+        }
+#endif
+        return lhs / rhs;
+    }
+
+    // remainder of lhs / rhs for non-zero rhs (std::fmod for floating-point)
+    static Value modulo(const Value& lhs, const Value& rhs) noexcept
+    {
+        if constexpr (std::is_floating_point_v<Value>) {
+            return std::fmod(lhs, rhs);
+        } else {
+#if defined(TECALC_HAS_INT128)
+            if constexpr (std::is_same_v<Value, int128_t>) {
+                if (fits_int64(lhs) && fits_int64(rhs) && rhs != -1) {
+                    return static_cast<std::int64_t>(lhs) % static_cast<std::int64_t>(rhs);
+                }
+            } else if constexpr (std::is_same_v<Value, uint128_t>) {
+                if ((lhs >> 64) == 0 && (rhs >> 64) == 0) {
+                    return static_cast<std::uint64_t>(lhs) % static_cast<std::uint64_t>(rhs);
+                }
+            }
+#endif
+            return lhs % rhs;
+        }
+    }
+
+private:
+    template <class T>
+    static bool fits_int64(T v) noexcept
+    {
+        return static_cast<std::int64_t>(v) == v;
+    }
+};
+
+//
+// tracing policy
+//
+// Tracer hooks are called on each evaluation step. Custom tracer can derive
+// from null_tracer and hide hook functions which it is interested in.
+struct null_tracer {
+    // evaluation of expression starts
+    void on_eval_begin(std::string_view /*expr*/) noexcept {}
+    // evaluation of expression ends, ev is errc{} on success (res is valid only on success)
+    template <class Value>
+    void on_eval_end(std::string_view /*expr*/, errc /*ev*/, const Value& /*res*/) noexcept {}
+    // unary operator '-' is applied: res = op operand
+    template <class Value>
+    void on_unary(char /*op*/, const Value& /*operand*/, const Value& /*res*/) noexcept {}
+    // binary operator is applied: res = lhs op rhs
+    template <class Value>
+    void on_binary(char /*op*/, const Value& /*lhs*/, const Value& /*rhs*/, const Value& /*res*/) noexcept {}
+    // variable is resolved
+    template <class Value>
+    void on_variable(std::string_view /*name*/, const Value& /*val*/) noexcept {}
+    // user-defined function is about to be invoked
+    void on_call_begin(std::string_view /*name*/) noexcept {}
+    // user-defined function has been invoked, ev is errc{} on success
+    void on_call_end(std::string_view /*name*/, errc /*ev*/) noexcept {}
+    // user-defined function returns: res = name(args...)
+    template <class Value>
+    void on_call(std::string_view /*name*/, const std::vector<Value>& /*args*/, const Value& /*res*/) noexcept {}
+    // user-defined function is called with wrong number of arguments
+    void on_arg_num_mismatch(std::string_view /*name*/, std::size_t /*nargs*/) noexcept {}
+    // evaluation fails
+    void on_error(errc /*ev*/, const error_location& /*loc*/) noexcept {}
+    // value is bound to variable name
+    template <class Value>
+    void on_bind_var(std::string_view /*name*/, const Value& /*val*/) noexcept {}
+    // function is bound to function name
+    void on_bind_fn(std::string_view /*name*/) noexcept {}
+};
+
+namespace impl {
+
+// storage of tracer object, which occupies no space for empty tracer
+// by empty base optimization (e.g. null_tracer)
+template <class Tracer, bool = std::is_empty_v<Tracer> && !std::is_final_v<Tracer>>
+class tracer_holder {
+public:
+    tracer_holder() = default;
+    explicit tracer_holder(Tracer tracer) : tracer_{std::move(tracer)} {}
+    Tracer& get_tracer() noexcept { return tracer_; }
+    const Tracer& get_tracer() const noexcept { return tracer_; }
+private:
+    Tracer tracer_;
+};
+
+template <class Tracer>
+class tracer_holder<Tracer, true> : private Tracer {
+public:
+    tracer_holder() = default;
+    explicit tracer_holder(Tracer tracer) : Tracer(std::move(tracer)) {}
+    Tracer& get_tracer() noexcept { return *this; }
+    const Tracer& get_tracer() const noexcept { return *this; }
+};
+
+} // namespace impl
+
+// streaming evaluator (tecalc_stream.hpp)
+template <class Calculator> class stream_evaluator;
+
 //
 // calculator class-templte
 //
-template <class Value, int MaxArgNum = 2>
-class basic_calculator {
+template <class Value, int MaxArgNum = 2, class Tracer = null_tracer>
+class basic_calculator : private impl::tracer_holder<Tracer> {
+    using tracer_holder_type = impl::tracer_holder<Tracer>;
 public:
     using value_type = Value;
+    using tracer_type = Tracer;
     using vartbl_type = std::map<std::string, value_type, std::less<>>;
 
     // function support
     static constexpr int kMaxArgNum = MaxArgNum;
-    using func_type = typename impl::func_variant<value_type, kMaxArgNum>::type;
+    // Value(*)(), ... Value(*)(Value_1, ...Value_n),
+    // eval_result<Value>(*)(), ... eval_result<Value>(*)(Value_1, ...Value_n)
+    using func_type = typename impl::variant_cat<
+        typename impl::func_variant<value_type, kMaxArgNum>::type,
+        typename impl::func_variant<value_type, kMaxArgNum, eval_result<value_type>>::type>::type;
     using functbl_type = std::map<std::string, func_type, std::less<>>;
 
+    basic_calculator() = default;
+    explicit basic_calculator(tracer_type tracer)
+        : tracer_holder_type{std::move(tracer)} {}
+
+    // evaluate expression string, return value and error code
+    eval_result<value_type> try_eval(std::string_view expr)
+    {
+        eval_result<value_type> res;
+        if (TECALC_UNLIKELY(!eval_expr(expr, res.value))) {
+            res.ec = last_errc_;
+        }
+        return res;
+    }
+
     // evaluate expression string, return optional<Value> or error_code
     std::optional<value_type> eval(std::string_view expr, std::error_code& ec)
     {
-        ptr_ = expr.data();
-        last_ = expr.data() + expr.length();
-        last_id_ = {};
-        last_errc_ = errc{};
-        auto res = eval_addsub();
-        if (eat_ws()) {
-            // We treat as syntax error when unevaluated redundant subsequent characters remain.
-            res = std::nullopt;
-        }
-        if (!res) {
-            // If last_errc_ is unset and result is nullopt, report as generic syntax error.
-            ec = std::make_error_code(last_errc_ != errc{} ? last_errc_ : errc::syntax_error);
+        value_type res;
+        if (TECALC_UNLIKELY(!eval_expr(expr, res))) {
+            set_error_code(ec);
+            return std::nullopt;
         }
         return res;
     }
@@ -212,17 +548,42 @@ public:
     // evaluate expression string, return Value or throw tecalc_error
     value_type eval(std::string_view expr)
     {
-        std::error_code ec;
-        auto res = eval(expr, ec);
-        if (ec.value()) {
-            throw tecalc_error(static_cast<errc>(ec.value()));
+        value_type res;
+        if (TECALC_UNLIKELY(!eval_expr(expr, res))) {
+            throw_error();
         }
-        return *res;
+        return res;
+    }
+
+    // location of error in the last failed evaluation
+    const error_location& last_error_location() const noexcept
+    {
+        return errloc_;
+    }
+
+    // bound variables
+    const vartbl_type& variables() const noexcept { return vartbl_; }
+
+    // bound functions
+    const functbl_type& functions() const noexcept { return functbl_; }
+
+    // pointer to value of bound variable, or nullptr if not bound
+    //   It is valid until the variable is unbound, and assignment through it
+    //   rebinds the variable without calling tracer (for batch evaluation).
+    value_type* find_var(std::string_view name) noexcept
+    {
+        auto var = vartbl_.find(name);
+        return var != vartbl_.end() ? &var->second : nullptr;
     }
 
+    // access to tracer object
+    tracer_type& tracer() noexcept { return this->get_tracer(); }
+    const tracer_type& tracer() const noexcept { return this->get_tracer(); }
+
     // bind value to variable name
     basic_calculator& bind_var(std::string name, value_type val)
     {
+        tracer().on_bind_var(name, val);
         functbl_.erase(name);
         vartbl_[name] = val;
         return *this;
@@ -231,12 +592,16 @@ public:
     // bind function pointer to function name
     basic_calculator& bind_fn(std::string name, func_type fn)
     {
+        tracer().on_bind_fn(name);
         vartbl_.erase(name);
-        functbl_[name] = std::move(fn);
+        functbl_.insert_or_assign(std::move(name), fn);
         return *this;
     }
 
 private:
+    // stream_evaluator shares tables, tracer and literal parser
+    friend class stream_evaluator<basic_calculator>;
+
     // input expression [ptr_, last_)
     const char* ptr_;
     const char* last_;
@@ -248,8 +613,70 @@ private:
     std::string_view last_id_;
     // last error code
     errc last_errc_;
+    // erroneous token [err_first_, err_last_) of last error
+    const char* err_first_;
+    const char* err_last_;
+    // location of last error (updated only on failure)
+    error_location errloc_;
+    // tracing policy object is held by base class tracer_holder
 
 private:
+    // Error handling functions below are out-of-line and marked as cold,
+    // to keep inlined evaluation code small.
+
+    // record error code and erroneous token, always return false
+    TECALC_COLD bool set_error(errc ev, const char* first, const char* last) noexcept
+    {
+        while (first != last && (last[-1] == ' ' || last[-1] == '\t')) {
+            --last;
+        }
+        last_errc_ = ev;
+        err_first_ = first;
+        err_last_ = last;
+        return false;
+    }
+
+    // record invalid literal error from begin to end of literal-like token
+    TECALC_COLD bool set_literal_error(const char* begin) noexcept
+    {
+        return set_error(errc::invalid_literal, begin, alnum_end());
+    }
+
+    // finalize failed evaluation of expr, always return false
+    TECALC_COLD bool fail_expr(std::string_view expr) noexcept
+    {
+        // If last_errc_ is unset, report as generic syntax error
+        // at the position where parsing stopped.
+        if (last_errc_ == errc{}) {
+            set_error(errc::syntax_error, ptr_, ptr_);
+        }
+        errloc_ = {static_cast<size_t>(err_first_ - expr.data()),
+                   static_cast<size_t>(err_last_ - err_first_)};
+        tracer().on_error(last_errc_, errloc_);
+        tracer().on_eval_end(expr, last_errc_, value_type{});
+        return false;
+    }
+
+    TECALC_COLD void set_error_code(std::error_code& ec) const noexcept
+    {
+        ec = make_error_code(last_errc_);
+    }
+
+    [[noreturn]] TECALC_COLD void throw_error() const
+    {
+        throw tecalc_error(last_errc_, errloc_);
+    }
+
+    // end of consecutive alphabet/digit characters from ptr_
+    const char* alnum_end() const noexcept
+    {
+        const char* p = ptr_;
+        while (p != last_ && isalnum(*p)) {
+            ++p;
+        }
+        return p;
+    }
+
     // skip consecutive whitespace characters
     bool eat_ws() noexcept
     {
@@ -296,29 +723,44 @@ private:
     static bool isalpha(char x) noexcept { return ('a' <= x && x <= 'z') || ('A' <= x && x <= 'Z'); }
     static bool isalnum(char x) noexcept { return isdigit(x) || isalpha(x); }
 
+    // evaluate whole expression, and store its value into res.
+    // Grammar functions below return false on failure, and report its reason
+    // by last_errc_ (if unset, it is treated as generic syntax error).
+    bool eval_expr(std::string_view expr, value_type& res)
+    {
+        ptr_ = expr.data();
+        last_ = expr.data() + expr.length();
+        last_id_ = {};
+        last_errc_ = errc{};
+        tracer().on_eval_begin(expr);
+        // We treat as syntax error when unevaluated redundant subsequent characters remain.
+        if (TECALC_LIKELY(eval_addsub(res) && !eat_ws())) {
+            tracer().on_eval_end(expr, errc{}, res);
+            return true;
+        }
+        return fail_expr(expr);
+    }
+
     // integer := {0-9}+
     //         | {"0x"|"0X"} {0-9|a-f|A-F}+
     //         | {"0b"|"0B"} {'0'|'1'}+
-    std::optional<value_type> parse_int()
+    bool parse_int(value_type& val)
     {
-        value_type val;
+        const char* begin = ptr_;
         int base = 10;
         if (consume_str("0x") || consume_str("0X")) {
             base = 16;
         } else if (consume_str("0b") || consume_str("0B")) {
             base = 2;
         }
-        auto [p, ec] = std::from_chars(ptr_, last_, val, base);
-        if (ec != std::errc{}) {
-            last_errc_ = errc::invalid_literal;
-            return {};
-        }
-        if (p != last_ && isalnum(*p)) {
-            last_errc_ = errc::invalid_literal;
-            return {};
+        const char* p = value_traits<value_type>::parse_literal(ptr_, last_, base, val);
+        if (TECALC_UNLIKELY(!p || (p != last_ && isalnum(*p)))) {
+            // error spans trailing characters after fractional part, if any
+            if (p) ptr_ = p;
+            return set_literal_error(begin);
         }
         ptr_ = p;
-        return val;
+        return true;
     }
 
     // identifier := {a-z|A-Z} {a-z|A-Z|0-9}*
@@ -334,9 +776,9 @@ private:
     // primary := '(' addsub ')'
     //          | integer
     //          | identifier
-    std::optional<value_type> eval_primary()
+    bool eval_primary(value_type& res)
     {
-        if (!eat_ws()) return {};
+        if (TECALC_UNLIKELY(!eat_ws())) return false;
         if (consume_ch('(')) {
             // Here we process consecutive parentheses
             // to keep C++ function call stack shallow.
@@ -344,144 +786,185 @@ private:
             while (eat_ws() && consume_ch('(')) {
                 ++depth;
             }
-            auto res = eval_addsub();
+            if (TECALC_UNLIKELY(!eval_addsub(res))) return false;
             while (0 < depth--) {
-                if (!eat_ws() || !consume_ch(')')) return {};
+                if (TECALC_UNLIKELY(!eat_ws() || !consume_ch(')'))) return false;
+                // The parenthesized value may be the first operand of enclosing
+                // expression like "((inner) * x + y)", so continue evaluating it.
+                if (0 < depth && TECALC_UNLIKELY(!(eval_muldiv_rest(res) && eval_addsub_rest(res)))) return false;
             }
-            return res;
+            return true;
         } else if (isdigit(*ptr_)) {
-            return parse_int();
+            return parse_int(res);
         } else {
             auto name = parse_id();
-            if (!name) return {};
+            if (TECALC_UNLIKELY(!name)) return false;
             last_id_ = {name, static_cast<size_t>(ptr_ - name)};
             // Here we try to resolve identifier as variable name.
             // If it isn't variable, handle in caller eval_postfix().
             auto var = vartbl_.find(last_id_);
             if (var == vartbl_.end()) {
+                // error location is recorded in eval_postfix() if needed
                 last_errc_ = errc::unknown_identifier;
-                return {};
+                return false;
             }
             last_id_ = {}; // resolved as variable name
-            return var->second;
+            res = var->second;
+            tracer().on_variable(var->first, res);
+            return true;
         }
     }
 
     // postfix   := primary {'(' arguments? ')'}?
     // arguments := addsub {',' addsub}*
-    std::optional<value_type> eval_postfix()
+    bool eval_postfix(value_type& res)
     {
-        auto res = eval_primary();
-        if (!res && last_errc_ != errc::unknown_identifier) return {};
+        if (!eval_primary(res) && last_errc_ != errc::unknown_identifier) return false;
         eat_ws();
         if (consume_ch('(')) {
             if (last_id_.empty()) {
                 // When non-function name followed by '(', report syntax error.
-                last_errc_ = errc::syntax_error;
-                return {};
+                return set_error(errc::syntax_error, ptr_ - 1, ptr_);
             }
             // resolve as function name
+            const std::string_view fn_name = last_id_;
+            const char* name = fn_name.data();
             auto func = functbl_.find(last_id_);
-            if (func == functbl_.end()) {
-                last_errc_ = errc::unknown_identifier;
-                return {};
+            if (TECALC_UNLIKELY(func == functbl_.end())) {
+                return set_error(errc::unknown_identifier, name, name + last_id_.size());
             }
             last_id_ = {};
-            // evaluate arguments list
+            last_errc_ = errc{};    // resolved as function name
+            // evaluate arguments list (unterminated one fails, even if empty)
             std::vector<value_type> args;
-            while (eat_ws()) {
-                char op = consume_any({',', ')'});
-                if (op == ')') break;
-                auto arg = eval_addsub();
-                if (!arg) return {};
-                args.push_back(*arg);
+            eat_ws();
+            if (!consume_ch(')')) {
+                for (;;) {
+                    value_type arg;
+                    if (TECALC_UNLIKELY(!eval_addsub(arg))) return false;
+                    args.push_back(arg);
+                    if (TECALC_UNLIKELY(!eat_ws())) return false;
+                    char op = consume_any({',', ')'});
+                    if (op == ')') break;
+                    if (TECALC_UNLIKELY(!op)) return false;
+                }
             }
             // invoke user-defined function
-            if (func->second.index() != args.size()) {
-                last_errc_ = errc::arg_num_mismatch;
-                return {};
+            const func_type& fn = func->second;
+            if (TECALC_UNLIKELY(fn.index() % (kMaxArgNum + 1) != args.size())) {
+                tracer().on_arg_num_mismatch(fn_name, args.size());
+                return set_error(errc::arg_num_mismatch, name, ptr_);
+            }
+            using invoker = impl::invoker<func_type>;
+            tracer().on_call_begin(fn_name);
+            eval_result<value_type> r = invoker::invoke(fn, args);
+            tracer().on_call_end(fn_name, r.ec);
+            if (TECALC_UNLIKELY(!r)) {
+                // propagate error code returned by function
+                return set_error(r.ec, name, ptr_);
             }
-            using invoker = impl::invoker<value_type, func_type, kMaxArgNum>;
-            res = invoker::invoke(func->second, args);
+            res = r.value;
+            tracer().on_call(fn_name, args, res);
         } else if (!last_id_.empty()) {
-            if (functbl_.find(last_id_) != functbl_.end()) {            
+            const char* name = last_id_.data();
+            if (functbl_.find(last_id_) != functbl_.end()) {
                 // When function name followed by non-'(', report syntax error.
-                last_errc_ = errc::syntax_error;
-                return {};
+                return set_error(errc::syntax_error, name, name + last_id_.size());
             }
+            return set_error(errc::unknown_identifier, name, name + last_id_.size());
         }
-        return res;
+        return true;
     }
 
     // unary := {'-'|'+'}* primary
-    std::optional<value_type> eval_unary()
+    bool eval_unary(value_type& res)
     {
         bool neg = false;
         char op;
         do {
-            if (!eat_ws()) return {};
+            if (TECALC_UNLIKELY(!eat_ws())) return false;
             op = consume_any({'+', '-'});
             neg ^= (op == '-');
         } while (op);
-        auto res = eval_postfix();
-        if (res && neg) {
-            return -*res;
-        } else {
-            return res;
+        if (TECALC_UNLIKELY(!eval_postfix(res))) return false;
+        if (neg) {
+            const value_type operand = res;
+            res = -res;
+            tracer().on_unary('-', operand, res);
         }
+        return true;
     }
 
     // muldiv := unary {'*'|'/'|'%' unary}*
-    std::optional<value_type> eval_muldiv()
+    bool eval_muldiv(value_type& res)
+    {
+        return eval_unary(res) && eval_muldiv_rest(res);
+    }
+
+    // {'*'|'/'|'%' unary}* with lhs operand res
+    bool eval_muldiv_rest(value_type& res)
     {
-        auto lhs = eval_unary();
-        if (!lhs) return {};
-        value_type res = *lhs;
         while (eat_ws()) {
+            const char* op_pos = ptr_;
             char op = consume_any({'*', '/', '%'});
-            if (!op) return res;
-            auto rhs = eval_unary();
-            if (!rhs) return {};
+            if (!op) return true;
+            value_type rhs;
+            if (TECALC_UNLIKELY(!eval_unary(rhs))) return false;
+            const value_type lhs = res;
             if (op == '*') {
-                res *= *rhs;
+                res *= rhs;
             } else {
-                if (*rhs == 0) {
-                    last_errc_ = errc::divide_by_zero;
-                    return {};
+                if (TECALC_UNLIKELY(rhs == 0)) {
+                    // report operator and divisor as erroneous token
+                    return set_error(errc::divide_by_zero, op_pos, ptr_);
                 }
                 if (op == '/') {
-                    res /= *rhs;
+                    res = value_traits<value_type>::divide(res, rhs);
                 } else {
-                    res %= *rhs;
+                    res = value_traits<value_type>::modulo(res, rhs);
                 }
             }
+            tracer().on_binary(op, lhs, rhs, res);
         }
-        return res;
+        return true;
     }
 
     // addsub := muldiv {'+'|'-' muldiv}*
-    std::optional<value_type> eval_addsub()
+    bool eval_addsub(value_type& res)
+    {
+        return eval_muldiv(res) && eval_addsub_rest(res);
+    }
+
+    // {'+'|'-' muldiv}* with lhs operand res
+    bool eval_addsub_rest(value_type& res)
     {
-        auto lhs = eval_muldiv();
-        if (!lhs) return {};
-        value_type res = *lhs;
         while (eat_ws()) {
             char op = consume_any({'+', '-'});
-            if (!op) return res;
-            auto rhs = eval_muldiv();
-            if (!rhs) return {};
+            if (!op) return true;
+            value_type rhs;
+            if (TECALC_UNLIKELY(!eval_muldiv(rhs))) return false;
+            const value_type lhs = res;
             if (op == '+') {
-                res += *rhs;
+                res += rhs;
             } else {
-                res -= *rhs;
+                res -= rhs;
             }
+            tracer().on_binary(op, lhs, rhs, res);
         }
-        return res;
+        return true;
     }
 };
 
 using calculator = basic_calculator<int>;
 
+// Define TECALC_EXTERN_TEMPLATE and link tecalc_lib (src/tecalc.cpp)
+// to use its explicit instantiations instead of instantiating in each TU.
+#if defined(TECALC_EXTERN_TEMPLATE)
+extern template class basic_calculator<int>;
+extern template class basic_calculator<long long>;
+extern template class basic_calculator<double>;
+#endif
+
 } // namespace tecalc
 
 #endif
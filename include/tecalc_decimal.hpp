@@ -0,0 +1,306 @@
+/*
+ * tecalc_decimal.hpp -- fixed-point decimal value type for tecalc
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_DECIMAL_HPP_INCLUDED_
+#define TECALC_DECIMAL_HPP_INCLUDED_
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include "tecalc.hpp"
+
+
+namespace tecalc {
+
+//
+// rounding mode of decimal
+//
+// All modes are symmetric about zero, since a number literal is rounded before
+// unary minus is applied; floor and ceiling would round "-1.005" to wrong side.
+//
+enum class rounding {
+    toward_zero,
+    away_from_zero,
+    half_up,        // round half away from zero
+    half_even,      // round half to even (banker's rounding)
+};
+
+namespace impl {
+
+// unsigned type of the same width as decimal storage
+template <class Storage> struct decimal_magnitude;
+template <> struct decimal_magnitude<std::int64_t> { using type = std::uint64_t; };
+#if defined(TECALC_HAS_INT128)
+template <> struct decimal_magnitude<int128_t> { using type = uint128_t; };
+#endif
+
+// powers of ten 10^0, 10^1, ... which fit in U
+template <class U>
+constexpr auto make_pow10() noexcept
+{
+    std::array<U, sizeof(U) == 8 ? 20 : 39> table{};
+    U v = 1;
+    for (auto& e : table) {
+        e = v;
+        v *= 10;
+    }
+    return table;
+}
+template <class U>
+constexpr auto pow10_table = make_pow10<U>();
+
+} // namespace impl
+
+//
+// fixed-point decimal
+//
+// decimal<Scale, Storage, Mode> represents value * 10^Scale as Storage integer
+// (std::int64_t or tecalc::int128_t), and rounds results of multiplication,
+// division and fractional literals by Mode. Addition and subtraction are exact.
+// Like built-in integers, overflow is not detected except in literals.
+//
+template <int Scale, class Storage = std::int64_t, rounding Mode = rounding::half_even>
+class decimal {
+public:
+    using storage_type = Storage;
+    using magnitude_type = typename impl::decimal_magnitude<Storage>::type;
+    static constexpr int scale = Scale;
+    static constexpr rounding rounding_mode = Mode;
+    static_assert(0 <= Scale && Scale <= 18, "scale must be in [0, 18]");
+    // raw representation of 1
+    static constexpr magnitude_type one = impl::pow10_table<magnitude_type>[Scale];
+
+    constexpr decimal() noexcept = default;
+
+    // integer value
+    template <class I, std::enable_if_t<std::is_integral_v<I>, int> = 0>
+    constexpr decimal(I v) noexcept
+        : raw_{static_cast<Storage>(static_cast<Storage>(v) * static_cast<Storage>(one))} {}
+
+    // value of raw * 10^-Scale
+    static constexpr decimal from_raw(Storage raw) noexcept
+    {
+        decimal d;
+        d.raw_ = raw;
+        return d;
+    }
+    constexpr Storage raw() const noexcept { return raw_; }
+
+    double to_double() const noexcept
+    {
+        return static_cast<double>(raw_) / static_cast<double>(one);
+    }
+
+    // decimal notation with Scale fractional digits, e.g. "-1.500000"
+    std::string to_string() const
+    {
+        std::string s;
+        magnitude_type mag = magnitude(raw_);
+        for (int i = 0; i < Scale; ++i, mag /= 10) {
+            s += static_cast<char>('0' + static_cast<int>(mag % 10));
+        }
+        if (0 < Scale) s += '.';
+        do {
+            s += static_cast<char>('0' + static_cast<int>(mag % 10));
+            mag /= 10;
+        } while (mag);
+        if (raw_ < 0) s += '-';
+        return {s.rbegin(), s.rend()};
+    }
+
+    constexpr decimal operator-() const noexcept { return from_raw(static_cast<Storage>(-raw_)); }
+    decimal& operator+=(const decimal& rhs) noexcept { raw_ += rhs.raw_; return *this; }
+    decimal& operator-=(const decimal& rhs) noexcept { raw_ -= rhs.raw_; return *this; }
+    decimal& operator*=(const decimal& rhs) noexcept { return *this = *this * rhs; }
+    decimal& operator/=(const decimal& rhs) noexcept { return *this = *this / rhs; }
+    decimal& operator%=(const decimal& rhs) noexcept { raw_ %= rhs.raw_; return *this; }
+
+    friend decimal operator+(decimal lhs, const decimal& rhs) noexcept { return lhs += rhs; }
+    friend decimal operator-(decimal lhs, const decimal& rhs) noexcept { return lhs -= rhs; }
+    friend decimal operator%(decimal lhs, const decimal& rhs) noexcept { return lhs %= rhs; }
+
+    // raw = lhs.raw * rhs.raw / 10^Scale, rounded
+    friend decimal operator*(const decimal& lhs, const decimal& rhs) noexcept
+    {
+        const magnitude_type a = magnitude(lhs.raw_), b = magnitude(rhs.raw_);
+        const bool neg = (lhs.raw_ < 0) != (rhs.raw_ < 0);
+        magnitude_type q, r;
+#if defined(TECALC_HAS_INT128)
+        if constexpr (sizeof(magnitude_type) == 8) {
+            const uint128_t p = uint128_t{a} * b;
+            q = static_cast<magnitude_type>(p / one);
+            r = static_cast<magnitude_type>(p % one);
+        } else
+#endif
+        {
+            // (qa * one + ra) * (qb * one + rb) / one, where ra * rb < 10^(2*Scale) fits
+            static_assert(sizeof(magnitude_type) == 16 || Scale <= 9, "scale of 64-bit storage must be in [0, 9] without 128-bit integer");
+            const magnitude_type qa = a / one, ra = a % one, qb = b / one, rb = b % one;
+            const magnitude_type low = ra * rb;
+            q = qa * qb * one + qa * rb + ra * qb + low / one;
+            r = low % one;
+        }
+        return from_magnitude(round(q, r, one), neg);
+    }
+
+    // raw = lhs.raw * 10^Scale / rhs.raw, rounded (rhs must not be zero)
+    friend decimal operator/(const decimal& lhs, const decimal& rhs) noexcept
+    {
+        const magnitude_type a = magnitude(lhs.raw_), b = magnitude(rhs.raw_);
+        const bool neg = (lhs.raw_ < 0) != (rhs.raw_ < 0);
+        magnitude_type q, r;
+#if defined(TECALC_HAS_INT128)
+        if constexpr (sizeof(magnitude_type) == 8) {
+            const uint128_t p = uint128_t{a} * one;
+            q = static_cast<magnitude_type>(p / b);
+            r = static_cast<magnitude_type>(p % b);
+        } else
+#endif
+        {
+            q = a / b;
+            r = a % b;
+            if (r <= ~magnitude_type{0} / one) {
+                const magnitude_type t = r * one;
+                q = q * one + t / b;
+                r = t % b;
+            } else {
+                // long division by decimal digit, where r * 10 may overflow
+                for (int i = 0; i < Scale; ++i) {
+                    magnitude_type x = 0, d = 0;
+                    for (int k = 0; k < 10; ++k) {
+                        // x += r (mod b)
+                        if (b - r <= x) {
+                            x -= b - r;
+                            ++d;
+                        } else {
+                            x += r;
+                        }
+                    }
+                    q = q * 10 + d;
+                    r = x;
+                }
+            }
+        }
+        return from_magnitude(round(q, r, b), neg);
+    }
+
+    friend constexpr bool operator==(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ == rhs.raw_; }
+    friend constexpr bool operator!=(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ != rhs.raw_; }
+    friend constexpr bool operator<(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ < rhs.raw_; }
+    friend constexpr bool operator<=(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ <= rhs.raw_; }
+    friend constexpr bool operator>(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ > rhs.raw_; }
+    friend constexpr bool operator>=(const decimal& lhs, const decimal& rhs) noexcept { return lhs.raw_ >= rhs.raw_; }
+
+    friend std::ostream& operator<<(std::ostream& os, const decimal& v)
+    {
+        return os << v.to_string();
+    }
+
+    // round magnitude of quotient q with remainder r of divisor d (r < d) by Mode
+    static constexpr magnitude_type round(magnitude_type q, magnitude_type r, magnitude_type d) noexcept
+    {
+        bool up = false;
+        if constexpr (Mode == rounding::away_from_zero) {
+            up = r != 0;
+        } else if constexpr (Mode == rounding::half_up) {
+            up = d - r <= r;
+        } else if constexpr (Mode == rounding::half_even) {
+            up = d - r < r || (d - r == r && (q & 1));
+        }
+        return q + (up ? 1 : 0);
+    }
+
+private:
+    static constexpr magnitude_type magnitude(Storage v) noexcept
+    {
+        // negate in unsigned type to avoid overflow of minimum value
+        return v < 0 ? static_cast<magnitude_type>(0 - static_cast<magnitude_type>(v)) : static_cast<magnitude_type>(v);
+    }
+    static constexpr decimal from_magnitude(magnitude_type mag, bool neg) noexcept
+    {
+        return from_raw(static_cast<Storage>(neg ? 0 - mag : mag));
+    }
+
+    Storage raw_ = 0;
+};
+
+//
+// value traits of decimal
+//
+// Number literal may have fractional part in base 10 ("1.25"), and digits
+// beyond Scale are rounded by Mode. Since Mode is symmetric about zero, it is
+// the same as rounding after unary minus is applied.
+//
+template <int Scale, class Storage, rounding Mode>
+struct value_traits<decimal<Scale, Storage, Mode>> {
+    using value_type = decimal<Scale, Storage, Mode>;
+    using magnitude_type = typename value_type::magnitude_type;
+
+    static const char* parse_literal(const char* first, const char* last, int base, value_type& val) noexcept
+    {
+        constexpr magnitude_type max = ~magnitude_type{0} >> 1;
+        constexpr magnitude_type one = value_type::one;
+        // integer part
+        const char* p = first;
+        magnitude_type ipart = 0;
+        for (; p != last; ++p) {
+            const int d = impl::digit_value(*p);
+            if (d < 0 || base <= d) break;
+            if ((max / one - static_cast<magnitude_type>(d)) / static_cast<unsigned>(base) < ipart) return nullptr;
+            ipart = ipart * static_cast<unsigned>(base) + static_cast<unsigned>(d);
+        }
+        if (p == first) return nullptr;
+        // fractional part, which needs at least one digit after '.'
+        magnitude_type fpart = 0;
+        unsigned rest = 0;      // 2 * (first dropped digit) + (any non-zero digit after it)
+        if (base == 10 && p != last && *p == '.' && p + 1 != last && '0' <= p[1] && p[1] <= '9') {
+            int n = 0;
+            for (++p; p != last && '0' <= *p && *p <= '9'; ++p, ++n) {
+                const unsigned d = static_cast<unsigned>(*p - '0');
+                if (n < Scale) {
+                    fpart = fpart * 10 + d;
+                } else if (n == Scale) {
+                    rest = 2 * d;
+                } else if (d != 0) {
+                    rest |= 1;
+                }
+            }
+            if (n < Scale) fpart *= impl::pow10_table<magnitude_type>[Scale - n];
+        }
+        magnitude_type mag = value_type::round(ipart * one + fpart, rest, 20);
+        if (max < mag) return nullptr;
+        val = value_type::from_raw(static_cast<typename value_type::storage_type>(mag));
+        return p;
+    }
+
+    static value_type divide(const value_type& lhs, const value_type& rhs) noexcept { return lhs / rhs; }
+    static value_type modulo(const value_type& lhs, const value_type& rhs) noexcept { return lhs % rhs; }
+};
+
+} // namespace tecalc
+
+#endif
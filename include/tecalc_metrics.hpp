@@ -0,0 +1,525 @@
+/*
+ * tecalc_metrics.hpp -- evaluation metrics for tecalc
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_METRICS_HPP_INCLUDED_
+#define TECALC_METRICS_HPP_INCLUDED_
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tecalc.hpp"
+
+
+namespace tecalc {
+
+namespace impl {
+
+inline const char* errc2name(errc ev) noexcept
+{
+    switch (ev) {
+    case errc::syntax_error: return "syntax_error";
+    case errc::invalid_literal: return "invalid_literal";
+    case errc::unknown_identifier: return "unknown_identifier";
+    case errc::arg_num_mismatch: return "arg_num_mismatch";
+    case errc::divide_by_zero: return "divide_by_zero";
+    case errc::function_error: return "function_error";
+    }
+    return "unknown";
+}
+
+// floor(log2(v)) for v > 0
+inline int floor_log2(std::uint64_t v) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(v);
+#else
+    int n = 0;
+    while (v >>= 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+} // namespace impl
+
+//
+// latency histogram
+//
+// HDR-style log-linear histogram of nanosecond values. Values are grouped by
+// power-of-two magnitude, and each magnitude is divided into kSubCount linear
+// sub-buckets. Relative error of recorded value is at most 1/kSubCount.
+class latency_histogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kSubCount = 1 << kSubBits;
+    static constexpr int kBucketCount = (64 - kSubBits + 1) * kSubCount;
+
+    void record(std::uint64_t ns) noexcept
+    {
+        ++buckets_[index_of(ns)];
+        ++count_;
+        sum_ += ns;
+        if (max_ < ns) max_ = ns;
+    }
+
+    void merge(const latency_histogram& other) noexcept
+    {
+        for (int i = 0; i < kBucketCount; ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (max_ < other.max_) max_ = other.max_;
+    }
+
+    std::uint64_t count() const noexcept { return count_; }
+    std::uint64_t sum() const noexcept { return sum_; }
+    std::uint64_t max() const noexcept { return max_; }
+
+    // number of recorded values less than ns (ns must be power of two)
+    std::uint64_t count_below(std::uint64_t ns) const noexcept
+    {
+        std::uint64_t n = 0;
+        for (int i = 0, last = index_of(ns); i < last; ++i) {
+            n += buckets_[i];
+        }
+        return n;
+    }
+
+    // number of recorded values less than or equal to ns
+    // (ns + 1 must be lower bound of a bucket, e.g. power of two minus one)
+    std::uint64_t count_at_most(std::uint64_t ns) const noexcept
+    {
+        return count_below(ns + 1);
+    }
+
+    // approximate q-quantile (0.0 <= q <= 1.0) of recorded values
+    std::uint64_t percentile(double q) const noexcept
+    {
+        if (count_ == 0) return 0;
+        auto rank = static_cast<std::uint64_t>(q * count_);
+        std::uint64_t n = 0;
+        for (int i = 0; i < kBucketCount; ++i) {
+            n += buckets_[i];
+            if (rank < n) {
+                std::uint64_t upper = lower_bound(i + 1) - 1;
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+    // bucket index of value v
+    static int index_of(std::uint64_t v) noexcept
+    {
+        if (v < kSubCount) return static_cast<int>(v);
+        int shift = impl::floor_log2(v) - kSubBits;
+        return (shift + 1) * kSubCount + static_cast<int>((v >> shift) - kSubCount);
+    }
+
+    // lowest value in bucket index i
+    static std::uint64_t lower_bound(int i) noexcept
+    {
+        if (i < kSubCount) return static_cast<std::uint64_t>(i);
+        int shift = i / kSubCount - 1;
+        return static_cast<std::uint64_t>(kSubCount + i % kSubCount) << shift;
+    }
+
+private:
+    std::array<std::uint64_t, kBucketCount> buckets_{};
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t max_ = 0;
+};
+
+//
+// per-function call statistics
+//
+struct function_stats {
+    std::uint64_t calls = 0;            // number of invocations
+    std::uint64_t errors = 0;           // number of invocations returned error
+    std::uint64_t arg_num_mismatches = 0;
+    std::uint64_t total_ns = 0;         // cumulative time in function
+    std::uint64_t max_ns = 0;           // longest time in function
+
+    void merge(const function_stats& other) noexcept
+    {
+        calls += other.calls;
+        errors += other.errors;
+        arg_num_mismatches += other.arg_num_mismatches;
+        total_ns += other.total_ns;
+        if (max_ns < other.max_ns) max_ns = other.max_ns;
+    }
+};
+
+//
+// evaluation metrics
+//
+struct metrics_snapshot {
+    std::uint64_t evaluations = 0;
+    std::uint64_t operators = 0;
+    std::uint64_t variable_lookups = 0;
+    std::map<errc, std::uint64_t> errors;
+    std::map<std::string, function_stats, std::less<>> functions;
+    latency_histogram eval_latency;
+
+    // statistics of function, or nullptr if it has never been called
+    const function_stats* function(std::string_view name) const
+    {
+        auto it = functions.find(name);
+        return it != functions.end() ? &it->second : nullptr;
+    }
+
+    // accumulate metrics of other calculator (e.g. on other thread)
+    void merge(const metrics_snapshot& other)
+    {
+        evaluations += other.evaluations;
+        operators += other.operators;
+        variable_lookups += other.variable_lookups;
+        for (const auto& [ev, n] : other.errors) {
+            errors[ev] += n;
+        }
+        for (const auto& [name, fs] : other.functions) {
+            functions[name].merge(fs);
+        }
+        eval_latency.merge(other.eval_latency);
+    }
+};
+
+//
+// tracing policy which collects evaluation metrics
+//
+//   tecalc::basic_calculator<int, 2, tecalc::metrics_tracer> calc;
+//   ...
+//   tecalc::write_prometheus_file("tecalc.prom", calc.tracer().snapshot());
+//
+// Time spent in each user-defined function is measured unless disabled
+// by constructor, since it costs two clock reads per function call.
+class metrics_tracer : public null_tracer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit metrics_tracer(bool time_functions = true)
+        : time_functions_{time_functions} {}
+
+    const metrics_snapshot& snapshot() const noexcept { return data_; }
+    void reset() { data_ = {}; }
+
+    void on_eval_begin(std::string_view) noexcept
+    {
+        start_ = clock::now();
+    }
+    template <class Value>
+    void on_eval_end(std::string_view, errc ev, const Value&)
+    {
+        auto elapsed = clock::now() - start_;
+        data_.eval_latency.record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        ++data_.evaluations;
+        if (ev != errc{}) {
+            ++data_.errors[ev];
+        }
+    }
+    template <class Value>
+    void on_unary(char, const Value&, const Value&) noexcept
+    {
+        ++data_.operators;
+    }
+    template <class Value>
+    void on_binary(char, const Value&, const Value&, const Value&) noexcept
+    {
+        ++data_.operators;
+    }
+    template <class Value>
+    void on_variable(std::string_view, const Value&) noexcept
+    {
+        ++data_.variable_lookups;
+    }
+    void on_call_begin(std::string_view name)
+    {
+        call_ = &stats_of(name);
+        if (time_functions_) {
+            call_start_ = clock::now();
+        }
+    }
+    void on_call_end(std::string_view, errc ev) noexcept
+    {
+        if (time_functions_) {
+            auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - call_start_).count());
+            call_->total_ns += ns;
+            if (call_->max_ns < ns) call_->max_ns = ns;
+        }
+        ++call_->calls;
+        if (ev != errc{}) {
+            ++call_->errors;
+        }
+    }
+    void on_arg_num_mismatch(std::string_view name, std::size_t)
+    {
+        ++stats_of(name).arg_num_mismatches;
+    }
+
+private:
+    function_stats& stats_of(std::string_view name)
+    {
+        auto it = data_.functions.find(name);
+        if (it == data_.functions.end()) {
+            it = data_.functions.emplace(std::string{name}, function_stats{}).first;
+        }
+        return it->second;
+    }
+
+    metrics_snapshot data_;
+    clock::time_point start_;
+    // function in progress
+    function_stats* call_ = nullptr;
+    clock::time_point call_start_;
+    bool time_functions_;
+};
+
+//
+// sampling profiler of hot expressions
+//
+// One in sample_interval evaluations on average is timed and attributed to its
+// expression string. Intervals between samples are drawn from geometric
+// distribution, so that periodic workloads are not aliased with fixed stride.
+// Non-sampled evaluations cost only a countdown. At most max_entries distinct
+// expressions are tracked; samples of other expressions are summed up as
+// untracked.
+//
+//   tecalc::basic_calculator<int, 2, tecalc::sampling_profiler> calc{tecalc::sampling_profiler{100}};
+//   ...
+//   for (const auto& e : calc.tracer().top(10)) { ... }
+//
+class sampling_profiler : public null_tracer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct entry {
+        std::string expr;
+        std::uint64_t samples = 0;      // number of sampled evaluations
+        std::uint64_t total_ns = 0;     // total time of sampled evaluations
+        std::uint64_t errors = 0;       // number of sampled evaluations failed
+        // estimated total time including non-sampled evaluations
+        std::uint64_t estimated_ns(std::uint64_t interval) const noexcept { return total_ns * interval; }
+    };
+
+    explicit sampling_profiler(std::uint64_t sample_interval = 100, std::size_t max_entries = 10000,
+                               std::uint64_t seed = 0x9e3779b97f4a7c15u)
+        : interval_{sample_interval ? sample_interval : 1}
+        , max_entries_{max_entries}
+        , rng_{seed ? seed : 1}
+        , countdown_{next_countdown()} {}
+
+    std::uint64_t sample_interval() const noexcept { return interval_; }
+    std::uint64_t untracked_samples() const noexcept { return untracked_.samples; }
+    std::uint64_t untracked_ns() const noexcept { return untracked_.total_ns; }
+
+    void on_eval_begin(std::string_view) noexcept
+    {
+        if (TECALC_LIKELY(--countdown_ != 0)) return;
+        countdown_ = next_countdown();
+        sampling_ = true;
+        start_ = clock::now();
+    }
+    template <class Value>
+    void on_eval_end(std::string_view expr, errc ev, const Value&)
+    {
+        if (TECALC_LIKELY(!sampling_)) return;
+        sampling_ = false;
+        auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - start_).count());
+        entry* e = &untracked_;
+        auto it = entries_.find(expr);
+        if (it != entries_.end()) {
+            e = &it->second;
+        } else if (entries_.size() < max_entries_) {
+            e = &entries_.emplace(std::string{expr}, entry{std::string{expr}}).first->second;
+        }
+        ++e->samples;
+        e->total_ns += ns;
+        if (ev != errc{}) {
+            ++e->errors;
+        }
+    }
+
+    // top-k expressions by total sampled time
+    std::vector<entry> top(std::size_t k) const
+    {
+        std::vector<const entry*> v;
+        v.reserve(entries_.size());
+        for (const auto& kv : entries_) {
+            v.push_back(&kv.second);
+        }
+        k = std::min(k, v.size());
+        std::partial_sort(v.begin(), v.begin() + k, v.end(), [](const entry* a, const entry* b) {
+            return a->total_ns > b->total_ns;
+        });
+        std::vector<entry> result;
+        result.reserve(k);
+        for (std::size_t i = 0; i < k; ++i) {
+            result.push_back(*v[i]);
+        }
+        return result;
+    }
+
+    // write top-k report as text table
+    void write_report(std::ostream& os, std::size_t k) const
+    {
+        std::uint64_t total = untracked_.total_ns;
+        for (const auto& kv : entries_) {
+            total += kv.second.total_ns;
+        }
+        char line[96];
+        std::snprintf(line, sizeof(line), "%7s %10s %12s %8s  %s\n", "share", "samples", "avg_ns", "errors", "expression");
+        os << line;
+        for (const auto& e : top(k)) {
+            std::snprintf(line, sizeof(line), "%6.2f%% %10llu %12.1f %8llu  ",
+                          total ? 100.0 * static_cast<double>(e.total_ns) / static_cast<double>(total) : 0.0,
+                          static_cast<unsigned long long>(e.samples),
+                          static_cast<double>(e.total_ns) / static_cast<double>(e.samples),
+                          static_cast<unsigned long long>(e.errors));
+            os << line << e.expr << '\n';
+        }
+        if (untracked_.samples) {
+            os << "(" << untracked_.samples << " samples of untracked expressions)\n";
+        }
+    }
+
+    void reset()
+    {
+        entries_.clear();
+        untracked_ = {};
+    }
+
+private:
+    // number of evaluations until next sample, geometrically distributed with mean interval_
+    std::uint64_t next_countdown() noexcept
+    {
+        if (interval_ == 1) return 1;
+        // xorshift64
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 7;
+        rng_ ^= rng_ << 17;
+        const double u = static_cast<double>((rng_ >> 11) + 1) * 0x1.0p-53;    // (0, 1]
+        const double n = std::floor(std::log(u) / std::log1p(-1.0 / static_cast<double>(interval_)));
+        return n < 1e18 ? static_cast<std::uint64_t>(n) + 1 : interval_;
+    }
+
+    std::uint64_t interval_;
+    std::size_t max_entries_;
+    std::uint64_t rng_;
+    std::uint64_t countdown_;
+    bool sampling_ = false;
+    clock::time_point start_;
+    std::map<std::string, entry, std::less<>> entries_;
+    entry untracked_;
+};
+
+//
+// Prometheus text exposition format
+//
+inline void write_prometheus(std::ostream& os, const metrics_snapshot& m, std::string_view prefix = "tecalc")
+{
+    auto counter = [&](const char* name, const char* help) {
+        os << "# HELP " << prefix << '_' << name << ' ' << help << '\n'
+           << "# TYPE " << prefix << '_' << name << " counter\n";
+    };
+    counter("evaluations_total", "Number of evaluated expressions.");
+    os << prefix << "_evaluations_total " << m.evaluations << '\n';
+    counter("errors_total", "Number of failed evaluations by error code.");
+    for (const auto& [ev, n] : m.errors) {
+        os << prefix << "_errors_total{errc=\"" << impl::errc2name(ev) << "\"} " << n << '\n';
+    }
+    counter("operators_total", "Number of applied unary/binary operators.");
+    os << prefix << "_operators_total " << m.operators << '\n';
+    counter("variable_lookups_total", "Number of resolved variables.");
+    os << prefix << "_variable_lookups_total " << m.variable_lookups << '\n';
+    counter("function_calls_total", "Number of user-defined function calls by function name.");
+    for (const auto& [name, fs] : m.functions) {
+        os << prefix << "_function_calls_total{function=\"" << name << "\"} " << fs.calls << '\n';
+    }
+    counter("function_errors_total", "Number of user-defined function calls returned error.");
+    for (const auto& [name, fs] : m.functions) {
+        os << prefix << "_function_errors_total{function=\"" << name << "\"} " << fs.errors << '\n';
+    }
+    counter("function_arg_num_mismatches_total", "Number of calls with wrong number of arguments.");
+    for (const auto& [name, fs] : m.functions) {
+        os << prefix << "_function_arg_num_mismatches_total{function=\"" << name << "\"} "
+           << fs.arg_num_mismatches << '\n';
+    }
+    char secs[32];
+    counter("function_seconds_total", "Cumulative time spent in user-defined function.");
+    for (const auto& [name, fs] : m.functions) {
+        std::snprintf(secs, sizeof(secs), "%.9g", static_cast<double>(fs.total_ns) * 1e-9);
+        os << prefix << "_function_seconds_total{function=\"" << name << "\"} " << secs << '\n';
+    }
+    // Histogram buckets are reported at power-of-two minus one nanoseconds from 63ns
+    // to about 17s, since 'le' is inclusive and a value of power of two shares its
+    // bucket with the following values.
+    const auto& h = m.eval_latency;
+    os << "# HELP " << prefix << "_eval_duration_seconds Evaluation latency.\n"
+       << "# TYPE " << prefix << "_eval_duration_seconds histogram\n";
+    char le[32];
+    for (int k = 6; k <= 34; ++k) {
+        const std::uint64_t upper = (std::uint64_t{1} << k) - 1;
+        std::snprintf(le, sizeof(le), "%.11g", static_cast<double>(upper) * 1e-9);
+        os << prefix << "_eval_duration_seconds_bucket{le=\"" << le << "\"} "
+           << h.count_at_most(upper) << '\n';
+    }
+    os << prefix << "_eval_duration_seconds_bucket{le=\"+Inf\"} " << h.count() << '\n';
+    std::snprintf(le, sizeof(le), "%.9g", static_cast<double>(h.sum()) * 1e-9);
+    os << prefix << "_eval_duration_seconds_sum " << le << '\n'
+       << prefix << "_eval_duration_seconds_count " << h.count() << '\n';
+}
+
+// write metrics to file, replacing it atomically for scrapers
+inline bool write_prometheus_file(const std::string& path, const metrics_snapshot& m,
+                                  std::string_view prefix = "tecalc")
+{
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream ofs{tmp, std::ios::trunc};
+        if (!ofs) return false;
+        write_prometheus(ofs, m, prefix);
+        if (!ofs.flush()) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+} // namespace tecalc
+
+#endif
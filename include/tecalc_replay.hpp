@@ -0,0 +1,299 @@
+/*
+ * tecalc_replay.hpp -- workload capture and replay for tecalc
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_REPLAY_HPP_INCLUDED_
+#define TECALC_REPLAY_HPP_INCLUDED_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "tecalc.hpp"
+
+
+namespace tecalc {
+
+//
+// workload file format
+//
+// header := "TCWL" version:u8 value_size:u8
+// record := 'V' name:str value       // bind_var(name, value)
+//         | 'F' name:str             // bind_fn(name, ...)
+//         | 'E' expr:str errc:u8 value   // eval(expr) returned value or errc
+// str    := length:u32 bytes
+// Integers are little-endian. Values are stored as raw object representation,
+// so workload files are portable only between hosts with the same Value layout.
+//
+enum class workload_tag : char {
+    bind_var = 'V',
+    bind_fn = 'F',
+    eval = 'E',
+};
+
+namespace impl {
+
+constexpr char kWorkloadMagic[4] = {'T', 'C', 'W', 'L'};
+constexpr std::uint8_t kWorkloadVersion = 1;
+
+inline void put_u32(std::ostream& os, std::uint32_t v)
+{
+    char buf[4] = {static_cast<char>(v), static_cast<char>(v >> 8),
+                   static_cast<char>(v >> 16), static_cast<char>(v >> 24)};
+    os.write(buf, 4);
+}
+
+inline bool get_u32(std::istream& is, std::uint32_t& v)
+{
+    unsigned char buf[4];
+    if (!is.read(reinterpret_cast<char*>(buf), 4)) return false;
+    v = buf[0] | (buf[1] << 8) | (buf[2] << 16) | (static_cast<std::uint32_t>(buf[3]) << 24);
+    return true;
+}
+
+inline void put_str(std::ostream& os, std::string_view s)
+{
+    put_u32(os, static_cast<std::uint32_t>(s.size()));
+    os.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+// string is read in bounded pieces, so that corrupted length does not
+// allocate more than the stream actually holds
+inline bool get_str(std::istream& is, std::string& s)
+{
+    constexpr std::uint32_t kPiece = 64 * 1024;
+    std::uint32_t len;
+    if (!get_u32(is, len)) return false;
+    s.clear();
+    while (len != 0) {
+        const std::uint32_t n = std::min(len, kPiece);
+        const std::size_t pos = s.size();
+        s.resize(pos + n);
+        if (!is.read(&s[pos], n)) return false;
+        len -= n;
+    }
+    return true;
+}
+
+template <class Value>
+inline void put_value(std::ostream& os, const Value& v)
+{
+    char buf[sizeof(Value)];
+    std::memcpy(buf, &v, sizeof(Value));
+    os.write(buf, sizeof(Value));
+}
+
+template <class Value>
+inline bool get_value(std::istream& is, Value& v)
+{
+    char buf[sizeof(Value)];
+    if (!is.read(buf, sizeof(Value))) return false;
+    std::memcpy(&v, buf, sizeof(Value));
+    return true;
+}
+
+} // namespace impl
+
+//
+// tracing policy which records workload
+//
+//   tecalc::basic_calculator<int, 2, tecalc::workload_recorder<int>> calc;
+//   std::ofstream ofs{"workload.bin", std::ios::binary};
+//   calc.tracer().start(ofs, calc.variables(), calc.functions());
+//   ...
+//   calc.tracer().stop();
+//
+template <class Value>
+class workload_recorder : public null_tracer {
+    static_assert(std::is_trivially_copyable_v<Value>, "Value must be trivially copyable");
+public:
+    // start recording into os, with snapshot of currently bound variables
+    // and names of functions, since bindings before start are not traced
+    template <class VarTbl = std::map<std::string, Value>, class FnTbl = std::map<std::string, int>>
+    void start(std::ostream& os, const VarTbl& vars = {}, const FnTbl& fns = {})
+    {
+        os.write(impl::kWorkloadMagic, sizeof(impl::kWorkloadMagic));
+        os.put(static_cast<char>(impl::kWorkloadVersion));
+        os.put(static_cast<char>(sizeof(Value)));
+        os_ = &os;
+        for (const auto& [name, val] : vars) {
+            on_bind_var(name, val);
+        }
+        for (const auto& fn : fns) {
+            on_bind_fn(fn.first);
+        }
+    }
+
+    // stop recording (does not close stream)
+    void stop() noexcept { os_ = nullptr; }
+    bool recording() const noexcept { return os_ != nullptr; }
+
+    void on_bind_var(std::string_view name, const Value& val)
+    {
+        if (!os_) return;
+        os_->put(static_cast<char>(workload_tag::bind_var));
+        impl::put_str(*os_, name);
+        impl::put_value(*os_, val);
+    }
+    void on_bind_fn(std::string_view name)
+    {
+        if (!os_) return;
+        os_->put(static_cast<char>(workload_tag::bind_fn));
+        impl::put_str(*os_, name);
+    }
+    void on_eval_end(std::string_view expr, errc ev, const Value& res)
+    {
+        if (!os_) return;
+        os_->put(static_cast<char>(workload_tag::eval));
+        impl::put_str(*os_, expr);
+        os_->put(static_cast<char>(ev));
+        impl::put_value(*os_, ev == errc{} ? res : Value{});
+    }
+
+private:
+    std::ostream* os_ = nullptr;
+};
+
+//
+// workload reader
+//
+template <class Value>
+struct workload_record {
+    workload_tag tag{};
+    std::string text;   // variable/function name or expression
+    errc ec{};          // (eval only)
+    Value value{};      // (bind_var and eval only)
+};
+
+// read all records of workload, return false if it is broken or Value mismatch
+template <class Value>
+bool read_workload(std::istream& is, std::vector<workload_record<Value>>& records)
+{
+    char magic[sizeof(impl::kWorkloadMagic)];
+    if (!is.read(magic, sizeof(magic))
+        || std::memcmp(magic, impl::kWorkloadMagic, sizeof(magic)) != 0
+        || is.get() != impl::kWorkloadVersion
+        || is.get() != static_cast<int>(sizeof(Value))) {
+        return false;
+    }
+    for (int tag; (tag = is.get()) != std::istream::traits_type::eof(); ) {
+        workload_record<Value> r;
+        r.tag = static_cast<workload_tag>(tag);
+        if (!impl::get_str(is, r.text)) return false;
+        switch (r.tag) {
+        case workload_tag::bind_var:
+            if (!impl::get_value(is, r.value)) return false;
+            break;
+        case workload_tag::bind_fn:
+            break;
+        case workload_tag::eval:
+            r.ec = static_cast<errc>(is.get());
+            if (!impl::get_value(is, r.value)) return false;
+            break;
+        default:
+            return false;
+        }
+        records.push_back(std::move(r));
+    }
+    return true;
+}
+
+//
+// workload replay
+//
+template <class Value>
+struct replay_report {
+    struct mismatch {
+        std::string expr;
+        errc expected_ec;
+        Value expected;
+        errc actual_ec;
+        Value actual;
+    };
+    std::uint64_t evaluations = 0;
+    std::uint64_t bindings = 0;
+    std::uint64_t mismatches = 0;
+    // evaluations which failed with unknown identifier, but not when recorded
+    std::uint64_t unbound = 0;
+    double seconds = 0.0;
+    std::vector<std::string> functions;     // function names which host must bind
+    std::vector<mismatch> first_mismatches; // (up to max_mismatches)
+
+    double throughput() const noexcept { return seconds > 0.0 ? evaluations / seconds : 0.0; }
+};
+
+// Replay workload records against calc, and compare results with recorded ones.
+// User-defined functions cannot be recorded, so they must be bound to calc in advance.
+// Bindings before the first evaluation are setup, and excluded from seconds.
+template <class Calculator>
+replay_report<typename Calculator::value_type>
+replay(const std::vector<workload_record<typename Calculator::value_type>>& records,
+       Calculator& calc, std::size_t max_mismatches = 10)
+{
+    using clock = std::chrono::steady_clock;
+    replay_report<typename Calculator::value_type> report;
+    auto start = clock::now();
+    bool started = false;
+    for (const auto& r : records) {
+        if (!started && r.tag == workload_tag::eval) {
+            started = true;
+            start = clock::now();
+        }
+        switch (r.tag) {
+        case workload_tag::bind_var:
+            calc.bind_var(r.text, r.value);
+            ++report.bindings;
+            break;
+        case workload_tag::bind_fn:
+            report.functions.push_back(r.text);
+            break;
+        case workload_tag::eval: {
+            auto res = calc.try_eval(r.text);
+            ++report.evaluations;
+            if (res.ec == errc::unknown_identifier && r.ec != errc::unknown_identifier) {
+                ++report.unbound;
+            }
+            if (res.ec != r.ec || (res && !(res.value == r.value))) {
+                if (report.mismatches++ < max_mismatches) {
+                    report.first_mismatches.push_back({r.text, r.ec, r.value, res.ec, res.value});
+                }
+            }
+            break;
+        }
+        }
+    }
+    report.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    return report;
+}
+
+} // namespace tecalc
+
+#endif
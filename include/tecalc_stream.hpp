@@ -0,0 +1,600 @@
+/*
+ * tecalc_stream.hpp -- streaming evaluator for tecalc
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_STREAM_HPP_INCLUDED_
+#define TECALC_STREAM_HPP_INCLUDED_
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "tecalc.hpp"
+
+
+namespace tecalc {
+
+template <class Calculator> class incremental_evaluator;
+
+//
+// streaming evaluator
+//
+// stream_evaluator evaluates an expression which is given in chunks by feed(),
+// e.g. read from pipe, without concatenating them into one buffer. Tokens are
+// evaluated as soon as they are complete with operator precedence on explicit
+// stacks, so memory usage is proportional to nesting depth of parentheses and
+// function calls and to length of the longest token, not to expression length.
+//
+// Results, errors and their locations (offset from the beginning of the whole
+// expression) are the same as basic_calculator::eval(), and tracer hooks are
+// called in the same order. on_eval_begin is called by the first feed() (or
+// finish) with empty string_view, since the expression is not known yet, and
+// on_eval_end receives the fed text, which is kept unless tracer is null_tracer.
+// Variables and functions are resolved when they are fed, so the calculator
+// must not be modified during evaluation.
+//
+template <class Calculator>
+class stream_evaluator {
+public:
+    using calculator_type = Calculator;
+    using value_type = typename Calculator::value_type;
+
+    explicit stream_evaluator(calculator_type& calc)
+        : calc_{&calc}
+    {
+        reset();
+    }
+
+    // start evaluation of new expression
+    void reset()
+    {
+        frames_.assign(1, frame{});
+        state_ = state::operand;
+        call_open_ = false;
+        paren_open_ = false;
+        in_token_ = false;
+        token_.clear();
+        offset_ = 0;
+        end_ = 0;
+        began_ = false;
+        text_.clear();
+    }
+
+    // feed next chunk of expression, return false if evaluation has failed
+    bool feed(std::string_view chunk)
+    {
+        if (state_ == state::failed) return false;
+        begin_eval();
+        if (keep_text()) text_.append(chunk);
+        const char* p = chunk.data();
+        const char* last = p + chunk.size();
+        while (p != last) {
+            if (in_token_) {
+                // identifier or literal may continue across chunks
+                const char* q = p;
+                // literal may have fractional part for decimal value type
+                while (q != last && (Calculator::isalnum(*q) || (*q == '.' && Calculator::isdigit(token_[0])))) {
+                    ++q;
+                }
+                token_.append(p, q);
+                offset_ += static_cast<std::size_t>(q - p);
+                end_ = offset_;
+                p = q;
+                if (p == last) break;
+                if (TECALC_UNLIKELY(!end_token())) return false;
+            }
+            const char c = *p++;
+            if (c != ' ' && c != '\t') {
+                if (TECALC_UNLIKELY(!step(c))) return false;
+                end_ = offset_ + 1;
+            }
+            ++offset_;
+        }
+        return true;
+    }
+
+    // finish expression, return value and error code
+    eval_result<value_type> try_finish()
+    {
+        eval_result<value_type> res;
+        if (TECALC_UNLIKELY(!finish_expr(res.value))) {
+            res.ec = ec_;
+        }
+        return res;
+    }
+
+    // finish expression, return optional<Value> or error_code
+    std::optional<value_type> finish(std::error_code& ec)
+    {
+        value_type res{};
+        if (TECALC_UNLIKELY(!finish_expr(res))) {
+            ec = make_error_code(ec_);
+            return std::nullopt;
+        }
+        return res;
+    }
+
+    // finish expression, return Value or throw tecalc_error
+    value_type finish()
+    {
+        value_type res{};
+        if (TECALC_UNLIKELY(!finish_expr(res))) {
+            throw tecalc_error(ec_, loc_);
+        }
+        return res;
+    }
+
+    // number of characters fed so far
+    std::size_t offset() const noexcept { return offset_; }
+
+    // whether evaluation has failed
+    bool failed() const noexcept { return state_ == state::failed; }
+
+private:
+    friend class incremental_evaluator<Calculator>;
+    using functbl_iterator = typename Calculator::functbl_type::const_iterator;
+
+    enum class state : unsigned char {
+        operand,    // expect unary operator or primary
+        ident,      // identifier is parsed, and wait for next token
+        postfix,    // literal or parenthesized operand is parsed, and wait for next token
+        binary,     // expect binary operator, ',' or ')'
+        done,
+        failed,
+    };
+    enum class frame_kind : unsigned char { top, paren, call };
+
+    // evaluation state of one nesting level
+    //   Pending operations are "sum sum_op (prod prod_op (-term))" with
+    //   operand term, where sum_op/prod_op are 0 if absent.
+    struct frame {
+        frame_kind kind = frame_kind::top;
+        char sum_op = 0;
+        char prod_op = 0;
+        bool neg = false;
+        // parenthesis directly follows '(', whose value skips postfix check
+        bool nested = false;
+        value_type sum{};
+        value_type prod{};
+        value_type term{};
+        std::size_t prod_offset = 0;
+        // function call
+        functbl_iterator func{};
+        std::size_t name_offset = 0;
+        std::vector<value_type> args;
+    };
+
+    // process non-whitespace character at offset_
+    bool step(char c)
+    {
+        switch (state_) {
+        case state::operand: {
+            if (c == ')' && call_open_) {
+                call_open_ = false;
+                return call(offset_ + 1);
+            }
+            const bool nested = paren_open_;
+            call_open_ = false;
+            paren_open_ = false;
+            if (c == '+' || c == '-') {
+                frames_.back().neg ^= (c == '-');
+                return true;
+            } else if (c == '(') {
+                frames_.emplace_back();
+                frames_.back().kind = frame_kind::paren;
+                frames_.back().nested = nested;
+                paren_open_ = true;
+                return true;
+            } else if (Calculator::isalnum(c)) {
+                in_token_ = true;
+                token_.assign(1, c);
+                token_offset_ = offset_;
+                return true;
+            }
+            return fail(errc::syntax_error, offset_, 0);
+        }
+        case state::ident:
+            if (c == '(') return open_call();
+            return resolve_ident() && step(c);
+        case state::postfix:
+            // non-function operand followed by '('
+            if (c == '(') return fail(errc::syntax_error, offset_, 1);
+            return push_operand(post_value_, post_end_) && step(c);
+        case state::binary:
+            return apply_binary(c);
+        default:
+            return fail(errc::syntax_error, offset_, 0);
+        }
+    }
+
+    // identifier or literal [token_offset_, offset_) is complete
+    bool end_token()
+    {
+        in_token_ = false;
+        const std::size_t token_end = token_offset_ + token_.size();
+        if (Calculator::isdigit(token_[0])) {
+            value_type val{};
+            calc_->ptr_ = token_.data();
+            calc_->last_ = token_.data() + token_.size();
+            if (TECALC_UNLIKELY(!calc_->parse_int(val))) {
+                return fail(errc::invalid_literal,
+                            token_offset_ + static_cast<std::size_t>(calc_->err_first_ - token_.data()),
+                            static_cast<std::size_t>(calc_->err_last_ - calc_->err_first_));
+            }
+            const std::size_t used = static_cast<std::size_t>(calc_->ptr_ - token_.data());
+            if (used == token_.size()) return wait_postfix(val, token_end);
+            // rest of token starts with '.' which is not part of literal
+            if (!push_operand(val, token_offset_ + used)) return false;
+            close_sum(frames_.back());
+            return fail(errc::syntax_error, token_offset_ + used, 0);
+        }
+        // try to resolve identifier as variable name
+        auto var = calc_->vartbl_.find(token_);
+        var_found_ = var != calc_->vartbl_.end();
+        if (var_found_) {
+            var_value_ = var->second;
+            calc_->tracer().on_variable(var->first, var_value_);
+        }
+        state_ = state::ident;
+        return true;
+    }
+
+    // operand is complete unless it is followed by '('
+    bool wait_postfix(value_type val, std::size_t end)
+    {
+        post_value_ = val;
+        post_end_ = end;
+        state_ = state::postfix;
+        return true;
+    }
+
+    // identifier is not followed by '('
+    bool resolve_ident()
+    {
+        if (var_found_) {
+            return push_operand(var_value_, token_offset_ + token_.size());
+        }
+        if (calc_->functbl_.find(token_) != calc_->functbl_.end()) {
+            // function name without argument list
+            return fail(errc::syntax_error, token_offset_, token_.size());
+        }
+        return fail(errc::unknown_identifier, token_offset_, token_.size());
+    }
+
+    // identifier is followed by '(' at offset_
+    bool open_call()
+    {
+        if (var_found_) {
+            return fail(errc::syntax_error, offset_, 1);
+        }
+        auto func = calc_->functbl_.find(token_);
+        if (TECALC_UNLIKELY(func == calc_->functbl_.end())) {
+            return fail(errc::unknown_identifier, token_offset_, token_.size());
+        }
+        frames_.emplace_back();
+        frame& f = frames_.back();
+        f.kind = frame_kind::call;
+        f.func = func;
+        f.name_offset = token_offset_;
+        state_ = state::operand;
+        call_open_ = true;
+        return true;
+    }
+
+    // invoke function of innermost frame, whose argument list ends at end
+    bool call(std::size_t end)
+    {
+        frame f = std::move(frames_.back());
+        frames_.pop_back();
+        const std::string_view name = f.func->first;
+        const auto& fn = f.func->second;
+        auto& tracer = calc_->tracer();
+        if (TECALC_UNLIKELY(fn.index() % (Calculator::kMaxArgNum + 1) != f.args.size())) {
+            tracer.on_arg_num_mismatch(name, f.args.size());
+            return fail(errc::arg_num_mismatch, f.name_offset, end - f.name_offset);
+        }
+        using invoker = impl::invoker<typename Calculator::func_type>;
+        tracer.on_call_begin(name);
+        eval_result<value_type> r = invoker::invoke(fn, f.args);
+        tracer.on_call_end(name, r.ec);
+        if (TECALC_UNLIKELY(!r)) {
+            // propagate error code returned by function
+            return fail(r.ec, f.name_offset, end - f.name_offset);
+        }
+        tracer.on_call(name, f.args, r.value);
+        return push_operand(r.value, end);
+    }
+
+    // apply unary and pending multiplicative operator to operand ending at end
+    bool push_operand(value_type val, std::size_t end)
+    {
+        frame& f = frames_.back();
+        auto& tracer = calc_->tracer();
+        if (f.neg) {
+            const value_type operand = val;
+            val = -val;
+            tracer.on_unary('-', operand, val);
+            f.neg = false;
+        }
+        state_ = state::binary;
+        if (!f.prod_op) {
+            f.term = val;
+            return true;
+        }
+        const char op = f.prod_op;
+        f.prod_op = 0;
+        f.term = f.prod;
+        if (op == '*') {
+            f.term *= val;
+        } else {
+            if (TECALC_UNLIKELY(val == 0)) {
+                // report operator and divisor as erroneous token
+                return fail(errc::divide_by_zero, f.prod_offset, end - f.prod_offset);
+            }
+            if (op == '/') {
+                f.term = value_traits<value_type>::divide(f.term, val);
+            } else {
+                f.term = value_traits<value_type>::modulo(f.term, val);
+            }
+        }
+        tracer.on_binary(op, f.prod, val, f.term);
+        return true;
+    }
+
+    // apply pending additive operator, and return value of frame
+    value_type close_sum(frame& f)
+    {
+        if (!f.sum_op) return f.term;
+        value_type res = f.sum;
+        if (f.sum_op == '+') {
+            res += f.term;
+        } else {
+            res -= f.term;
+        }
+        calc_->tracer().on_binary(f.sum_op, f.sum, f.term, res);
+        f.sum_op = 0;
+        return res;
+    }
+
+    // process character at offset_ after operand
+    bool apply_binary(char c)
+    {
+        frame& f = frames_.back();
+        switch (c) {
+        case '*':
+        case '/':
+        case '%':
+            f.prod = f.term;
+            f.prod_op = c;
+            f.prod_offset = offset_;
+            state_ = state::operand;
+            return true;
+        case '+':
+        case '-':
+            f.sum = close_sum(f);
+            f.sum_op = c;
+            state_ = state::operand;
+            return true;
+        case ')':
+            if (f.kind == frame_kind::paren) {
+                const value_type val = close_sum(f);
+                const bool nested = f.nested;
+                frames_.pop_back();
+                return nested ? push_operand(val, offset_ + 1) : wait_postfix(val, offset_ + 1);
+            } else if (f.kind == frame_kind::call) {
+                f.args.push_back(close_sum(f));
+                return call(offset_ + 1);
+            }
+            break;
+        case ',':
+            if (f.kind == frame_kind::call) {
+                f.args.push_back(close_sum(f));
+                state_ = state::operand;
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
+        // Enclosing additive expression is complete before unexpected token.
+        close_sum(f);
+        return fail(errc::syntax_error, offset_, 0);
+    }
+
+    bool finish_expr(value_type& res)
+    {
+        if (state_ == state::failed) {
+            // error may be reported again from a copy of failed evaluator
+            calc_->last_errc_ = ec_;
+            calc_->errloc_ = loc_;
+            return false;
+        }
+        begin_eval();
+        if (state_ == state::done) return fail(errc::syntax_error, offset_, 0);
+        if (in_token_ && !end_token()) return false;
+        if (state_ == state::ident && !resolve_ident()) return false;
+        if (state_ == state::postfix && !push_operand(post_value_, post_end_)) return false;
+        if (state_ == state::operand) return fail(errc::syntax_error, offset_, 0);
+        res = close_sum(frames_.back());
+        if (TECALC_UNLIKELY(frames_.size() != 1)) {
+            // unterminated parenthesis or argument list
+            return fail(errc::syntax_error, offset_, 0);
+        }
+        state_ = state::done;
+        if (trace_eval_) calc_->tracer().on_eval_end(text_, errc{}, res);
+        return true;
+    }
+
+    // text is passed to on_eval_end only
+    bool keep_text() const noexcept
+    {
+        return trace_eval_ && !std::is_same_v<typename Calculator::tracer_type, null_tracer>;
+    }
+
+    void begin_eval()
+    {
+        if (began_) return;
+        began_ = true;
+        if (trace_eval_) calc_->tracer().on_eval_begin(std::string_view{});
+    }
+
+    // record error and finish evaluation, always return false
+    TECALC_COLD bool fail(errc ev, std::size_t offset, std::size_t length)
+    {
+        state_ = state::failed;
+        ec_ = ev;
+        loc_ = {offset, length};
+        calc_->last_errc_ = ev;
+        calc_->errloc_ = loc_;
+        calc_->tracer().on_error(ev, loc_);
+        if (trace_eval_) calc_->tracer().on_eval_end(text_, ev, value_type{});
+        return false;
+    }
+
+    calculator_type* calc_;
+    // stack of nesting levels, whose bottom is top level of expression
+    std::vector<frame> frames_;
+    state state_;
+    // '(' of argument list or parenthesis was the last token
+    bool call_open_;
+    bool paren_open_;
+    // on_eval_begin has been called, and eval hooks are enabled
+    bool began_;
+    bool trace_eval_ = true;
+    // fed text for on_eval_end
+    std::string text_;
+    // identifier or literal being parsed
+    bool in_token_;
+    std::string token_;
+    std::size_t token_offset_ = 0;
+    // resolution of identifier token_ as variable
+    bool var_found_ = false;
+    value_type var_value_{};
+    // operand waiting for postfix check
+    value_type post_value_{};
+    std::size_t post_end_ = 0;
+    // number of characters fed, and end of the last non-whitespace character
+    std::size_t offset_;
+    std::size_t end_;
+    // error of failed evaluation
+    errc ec_{};
+    error_location loc_;
+};
+
+//
+// incremental evaluator
+//
+// incremental_evaluator keeps expression text which is modified by small edits,
+// e.g. in formula editor, and re-evaluates it after edits. It saves copies of
+// stream_evaluator every `interval` characters while evaluating, and next
+// evaluation resumes from the last saved state before the first edited offset,
+// so that unchanged prefix of the text is not evaluated again.
+// on_eval_begin and on_eval_end are called once per try_eval() with the whole
+// text, while other tracer hooks are called only for the re-evaluated part.
+// Call invalidate() after variables or functions of the calculator are changed.
+//
+template <class Calculator>
+class incremental_evaluator {
+public:
+    using calculator_type = Calculator;
+    using value_type = typename Calculator::value_type;
+
+    explicit incremental_evaluator(calculator_type& calc, std::size_t interval = 1024)
+        : calc_{&calc}, interval_{interval ? interval : 1}
+    {
+        invalidate();
+    }
+
+    // replace whole text
+    void assign(std::string_view text)
+    {
+        text_.assign(text);
+        invalidate();
+    }
+
+    // replace text [offset, offset + removed) with inserted text,
+    // throw std::out_of_range if offset is beyond the end of text
+    void edit(std::size_t offset, std::size_t removed, std::string_view inserted)
+    {
+        text_.replace(offset, removed, inserted);
+        dirty_ = std::min(dirty_, offset);
+    }
+
+    // evaluate current text, return value and error code
+    eval_result<value_type> try_eval()
+    {
+        calc_->tracer().on_eval_begin(text_);
+        // Saved state at pos depends only on text [0, pos).
+        while (dirty_ < saved_.back().first) {
+            saved_.pop_back();
+        }
+        dirty_ = text_.size();
+        reused_ = saved_.back().first;
+        for (std::size_t pos = reused_; pos < text_.size() && !saved_.back().second.failed(); ) {
+            const std::size_t n = std::min(interval_, text_.size() - pos);
+            stream_evaluator<Calculator> s = saved_.back().second;
+            s.feed(std::string_view{text_}.substr(pos, n));
+            pos += n;
+            saved_.emplace_back(pos, std::move(s));
+        }
+        // finish a copy to keep saved state reusable
+        stream_evaluator<Calculator> s = saved_.back().second;
+        auto res = s.try_finish();
+        calc_->tracer().on_eval_end(text_, res.ec, res.value);
+        return res;
+    }
+
+    // discard all saved states
+    void invalidate()
+    {
+        saved_.clear();
+        saved_.emplace_back(0, stream_evaluator<Calculator>{*calc_});
+        saved_.back().second.trace_eval_ = false;
+        dirty_ = 0;
+    }
+
+    const std::string& text() const noexcept { return text_; }
+
+    // number of characters whose evaluation is reused in the last try_eval()
+    std::size_t reused() const noexcept { return reused_; }
+
+private:
+    calculator_type* calc_;
+    std::size_t interval_;
+    std::string text_;
+    // evaluation state after text [0, first), in ascending order of first
+    std::vector<std::pair<std::size_t, stream_evaluator<Calculator>>> saved_;
+    // text [dirty_, end) has been edited since the last evaluation
+    std::size_t dirty_ = 0;
+    std::size_t reused_ = 0;
+};
+
+} // namespace tecalc
+
+#endif
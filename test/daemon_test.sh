@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# daemon_test.sh -- concurrent socket and shared-memory requests to tecalcd
+#
+# usage: daemon_test.sh TECALCD TECALCC
+#   Socket EVAL requests (batched on batch thread) and ring EVAL requests
+#   (evaluated on connection threads) of the same expression id run at once,
+#   and every result must be correct. Build tecalcd with -fsanitize=thread
+#   to detect data races between them.
+#
+set -e
+TECALCD=$1
+TECALCC=$2
+DIR=$(mktemp -d)
+SOCK="$DIR/tecalcd.sock"
+"$TECALCD" -D K=10 "$SOCK" 2> "$DIR/tecalcd.log" &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; rm -rf "$DIR"' EXIT
+
+i=0
+while [ ! -S "$SOCK" ]; do
+  i=$((i + 1))
+  [ $i -le 50 ] || { echo "tecalcd did not start"; exit 1; }
+  sleep 0.1
+done
+
+# same parameters and expression share one id
+"$TECALCC" -n 2000 -c 2 "$SOCK" "x * K + 1" x=3 > "$DIR/socket.out" 2>/dev/null &
+CLIENT=$!
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+  "$TECALCC" -s futex -n 5 -c 4 "$SOCK" "x * K + 1" x=3 2>/dev/null
+done > "$DIR/ring.out"
+wait $CLIENT
+
+status=0
+[ "$(cat "$DIR/socket.out")" = 31 ] || { echo "socket: $(cat "$DIR/socket.out")"; status=1; }
+[ "$(sort -u "$DIR/ring.out")" = 31 ] || { echo "ring: $(sort -u "$DIR/ring.out")"; status=1; }
+kill -INT $PID
+wait $PID || status=1
+cat "$DIR/tecalcd.log"
+exit $status
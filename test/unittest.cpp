@@ -27,6 +27,9 @@
 #define CATCH_CONFIG_MAIN
 #include <catch2/catch.hpp>
 #include "tecalc.hpp"
+#include "tecalc_metrics.hpp"
+#include "tecalc_replay.hpp"
+#include "tecalc_stream.hpp"
 
 // int-casted tecalc::errc enumerator for std::error_code::value()
 constexpr int syntax_error = static_cast<int>(tecalc::errc::syntax_error);
@@ -34,6 +37,7 @@ constexpr int invalid_literal = static_cast<int>(tecalc::errc::invalid_literal);
 constexpr int unknown_identifier = static_cast<int>(tecalc::errc::unknown_identifier);
 constexpr int arg_num_mismatch = static_cast<int>(tecalc::errc::arg_num_mismatch);
 constexpr int divide_by_zero = static_cast<int>(tecalc::errc::divide_by_zero);
+constexpr int function_error = static_cast<int>(tecalc::errc::function_error);
 
 // custom matcher for tecalc::tecalc_error
 auto IsErrc(tecalc::errc ev) {
@@ -53,6 +57,33 @@ auto IsErrc(tecalc::errc ev) {
     return TecalcErrorMatcher{ev};
 }
 
+// tracer which logs operations as strings
+struct recording_tracer : tecalc::null_tracer {
+    std::vector<std::string> log;
+    std::vector<std::string> evals;     // on_eval_begin/on_eval_end
+    void on_eval_begin(std::string_view expr) {
+        evals.push_back("begin:" + std::string{expr});
+    }
+    void on_eval_end(std::string_view expr, tecalc::errc ev, int res) {
+        evals.push_back("end:" + std::string{expr} + "=" + std::to_string(ev == tecalc::errc{} ? res : -1));
+    }
+    void on_unary(char op, int x, int res) {
+        log.push_back(std::string{op} + std::to_string(x) + "=" + std::to_string(res));
+    }
+    void on_binary(char op, int lhs, int rhs, int res) {
+        log.push_back(std::to_string(lhs) + op + std::to_string(rhs) + "=" + std::to_string(res));
+    }
+    void on_variable(std::string_view name, int val) {
+        log.push_back(std::string{name} + "=" + std::to_string(val));
+    }
+    void on_call(std::string_view name, const std::vector<int>& args, int res) {
+        log.push_back(std::string{name} + "#" + std::to_string(args.size()) + "=" + std::to_string(res));
+    }
+    void on_error(tecalc::errc ev, const tecalc::error_location& loc) {
+        log.push_back("error" + std::to_string(static_cast<int>(ev)) + "@" + std::to_string(loc.offset));
+    }
+};
+
 TEST_CASE("integer literals") {
     tecalc::calculator calc;
     std::error_code ec;
@@ -69,6 +100,8 @@ TEST_CASE("integer literals") {
     REQUIRE(calc.eval("0xG", ec) == std::nullopt); CHECK(ec.value() == invalid_literal);
     REQUIRE(calc.eval("0x8FG", ec) == std::nullopt); CHECK(ec.value() == invalid_literal);
     REQUIRE(calc.eval("0x+0", ec) == std::nullopt); CHECK(ec.value() == invalid_literal);
+    REQUIRE(calc.eval("0x-1", ec) == std::nullopt); CHECK(ec.value() == invalid_literal);
+    REQUIRE(calc.eval("0b-1", ec) == std::nullopt); CHECK(ec.value() == invalid_literal);
     // binary literal
     REQUIRE(calc.eval(" 0b1010 ") == 10);
     REQUIRE(calc.eval(" 0B0101 ") == 5);
@@ -132,6 +165,10 @@ TEST_CASE("parenthesis") {
     tecalc::calculator calc;
     REQUIRE(calc.eval(" ( 42 ) ") == 42);
     REQUIRE(calc.eval("((((((((((10))))))))))") == 10);
+    REQUIRE(calc.eval("((1) + 2)") == 3);
+    REQUIRE(calc.eval("((1 + 2) * 3 - (4))") == 5);
+    REQUIRE(calc.eval("(((2) * 3) + 4) * 5") == 50);
+    REQUIRE(calc.eval("((7) / 2 % 2 - 1)") == 0);
     // unmatched parenthesis
     std::error_code ec;
     REQUIRE(calc.eval(" (  ", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
@@ -143,6 +180,8 @@ TEST_CASE("parenthesis") {
     // empty parenthesis
     REQUIRE(calc.eval("()", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
     REQUIRE(calc.eval("(())", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("((1)(2))", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("((1) 2)", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
     // stress test
     constexpr size_t kDepth = 100000;
     std::string expr = std::string(kDepth, '(') + "42" + std::string(kDepth, ')');
@@ -179,6 +218,12 @@ TEST_CASE("variables") {
     // undefined varriable
     std::error_code ec;
     REQUIRE(calc.eval("undefined", ec) == std::nullopt); CHECK(ec.value() == unknown_identifier);
+    // rebind through variable pointer
+    int* px = calc.find_var("x");
+    REQUIRE(px != nullptr);
+    *px = 7;
+    REQUIRE(calc.eval("x * y") == 14);
+    CHECK(calc.find_var("undefined") == nullptr);
 }
 
 TEST_CASE("functions") {
@@ -202,6 +247,95 @@ TEST_CASE("functions") {
     REQUIRE(calc.eval("add(  1)", ec) == std::nullopt); CHECK(ec.value() == arg_num_mismatch);
 }
 
+TEST_CASE("error-returning functions") {
+    using result = tecalc::eval_result<int>;
+    static const int table[] = {10, 20, 30};
+    tecalc::calculator calc;
+    calc.bind_fn("at", [](int i) -> result {
+        if (i < 0 || 3 <= i) return {0, tecalc::errc::function_error};
+        return {table[i]};
+    });
+    calc.bind_fn("div", [](int a, int b) -> result {
+        if (b == 0) return {0, tecalc::errc::divide_by_zero};
+        return {a / b};
+    });
+    calc.bind_fn("sq", [](int x){ return x * x; });
+    REQUIRE(calc.eval("at(0) + at(2)") == 40);
+    REQUIRE(calc.eval("sq(at(1) / 10) * div(9, 3)") == 12);
+    REQUIRE(calc.try_eval("at(1)").value == 20);
+    // error propagation
+    std::error_code ec;
+    REQUIRE(calc.eval("1 + at(3)", ec) == std::nullopt); CHECK(ec.value() == function_error);
+    CHECK(calc.last_error_location().offset == 4);
+    CHECK(calc.last_error_location().length == 5);
+    REQUIRE(calc.eval("sq(at(-1))", ec) == std::nullopt); CHECK(ec.value() == function_error);
+    REQUIRE(calc.eval("div(1, 0)", ec) == std::nullopt); CHECK(ec.value() == divide_by_zero);
+    auto res = calc.try_eval("at(1) + at(5)");
+    CHECK(!res);
+    CHECK(static_cast<int>(res.ec) == function_error);
+    // argument number mismatch
+    REQUIRE(calc.eval("at()", ec) == std::nullopt); CHECK(ec.value() == arg_num_mismatch);
+    REQUIRE(calc.eval("div(1)", ec) == std::nullopt); CHECK(ec.value() == arg_num_mismatch);
+}
+
+TEST_CASE("maximum number of arguments") {
+    using result = tecalc::eval_result<int>;
+    tecalc::basic_calculator<int, 8> calc;
+    int (*sum8)(int, int, int, int, int, int, int, int) =
+        [](int a, int b, int c, int d, int e, int f, int g, int h){ return a + b + c + d + e + f + g + h; };
+    calc.bind_fn("sum8", sum8);
+    calc.bind_fn("sub7", [](int a, int b, int c, int d, int e, int f, int g) -> result {
+        if (g == 0) return {0, tecalc::errc::function_error};
+        return {a - b - c - d - e - f - g};
+    });
+    calc.bind_fn("neg", [](int a){ return -a; });
+    REQUIRE(calc.eval("sum8(1, 2, 3, 4, 5, 6, 7, 8)") == 36);
+    REQUIRE(calc.eval("sub7(28, 1, 2, 3, 4, 5, 6)") == 7);
+    REQUIRE(calc.eval("neg(sum8(0, 0, 0, 0, 0, 0, 0, neg(1)))") == 1);
+    std::error_code ec;
+    REQUIRE(calc.eval("sub7(1, 1, 1, 1, 1, 1, 0)", ec) == std::nullopt); CHECK(ec.value() == function_error);
+    REQUIRE(calc.eval("sum8(1, 2, 3, 4, 5, 6, 7)", ec) == std::nullopt); CHECK(ec.value() == arg_num_mismatch);
+    REQUIRE(calc.eval("sum8(1, 2, 3, 4, 5, 6, 7, 8, 9)", ec) == std::nullopt); CHECK(ec.value() == arg_num_mismatch);
+}
+
+TEST_CASE("function type alternatives") {
+    using result = tecalc::eval_result<int>;
+    using calc_type = tecalc::basic_calculator<int, 3>;
+    using func_type = calc_type::func_type;
+    int (*f0)() = []{ return 1; };
+    int (*f1)(int) = [](int a){ return a; };
+    int (*f2)(int, int) = [](int a, int b){ return a + b; };
+    int (*f3)(int, int, int) = [](int a, int b, int c){ return a + b + c; };
+    result (*g0)() = []() -> result { return {2}; };
+    result (*g1)(int) = [](int a) -> result { return {a * 2}; };
+    result (*g2)(int, int) = [](int a, int b) -> result { return {(a + b) * 2}; };
+    result (*g3)(int, int, int) = [](int a, int b, int c) -> result { return {(a + b + c) * 2}; };
+    // each arity is a distinct alternative, and stored pointer round-trips
+    const func_type fns[] = {f0, f1, f2, f3, g0, g1, g2, g3};
+    STATIC_REQUIRE(func_type::size == 8);
+    for (std::size_t i = 0; i < 8; ++i) {
+        CHECK(fns[i].index() == i);
+    }
+    CHECK(fns[0].target<int(*)()>() == f0);
+    CHECK(fns[1].target<int(*)(int)>() == f1);
+    CHECK(fns[2].target<int(*)(int, int)>() == f2);
+    CHECK(fns[3].target<int(*)(int, int, int)>() == f3);
+    CHECK(fns[4].target<result(*)()>() == g0);
+    CHECK(fns[5].target<result(*)(int)>() == g1);
+    CHECK(fns[6].target<result(*)(int, int)>() == g2);
+    CHECK(fns[7].target<result(*)(int, int, int)>() == g3);
+    CHECK(fns[1].target<int(*)()>() == nullptr);
+    CHECK(fns[4].target<int(*)()>() == nullptr);
+    CHECK(func_type{}.index() == 0);
+    CHECK(func_type{}.target<int(*)()>() == nullptr);
+    // and invoked with its own signature
+    calc_type calc;
+    calc.bind_fn("f0", fns[0]).bind_fn("f1", fns[1]).bind_fn("f2", fns[2]).bind_fn("f3", fns[3]);
+    calc.bind_fn("g0", fns[4]).bind_fn("g1", fns[5]).bind_fn("g2", fns[6]).bind_fn("g3", fns[7]);
+    CHECK(calc.eval("f0() + f1(10) + f2(100, 200) + f3(1000, 2000, 3000)") == 6311);
+    CHECK(calc.eval("g0() + g1(10) + g2(100, 200) + g3(1000, 2000, 3000)") == 12622);
+}
+
 TEST_CASE("variable/function namespace") {
     tecalc::calculator calc;
     calc.bind_var("v", 1).bind_fn("f", [](int n){ return n; });
@@ -232,6 +366,7 @@ TEST_CASE("exception handling") {
     REQUIRE_THAT(tecalc_category.message(unknown_identifier), Equals("Unknown identifier"));
     REQUIRE_THAT(tecalc_category.message(arg_num_mismatch), Equals("Argument number mismatch"));
     REQUIRE_THAT(tecalc_category.message(divide_by_zero), Equals("Divide by zero"));
+    REQUIRE_THAT(tecalc_category.message(function_error), Equals("Function error"));
     // throw tecalc_error
     static_assert(std::is_base_of<std::runtime_error, tecalc::tecalc_error>::value);
     tecalc::calculator calc;
@@ -241,6 +376,392 @@ TEST_CASE("exception handling") {
     REQUIRE_THROWS_MATCHES(calc.eval("und"), tecalc::tecalc_error, IsErrc(tecalc::errc::unknown_identifier));
     REQUIRE_THROWS_MATCHES(calc.eval("f()"), tecalc::tecalc_error, IsErrc(tecalc::errc::arg_num_mismatch));
     REQUIRE_THROWS_MATCHES(calc.eval("0/0"), tecalc::tecalc_error, IsErrc(tecalc::errc::divide_by_zero));
+    calc.bind_fn("err", []() -> tecalc::eval_result<int> { return {0, tecalc::errc::function_error}; });
+    REQUIRE_THROWS_MATCHES(calc.eval("err()"), tecalc::tecalc_error, IsErrc(tecalc::errc::function_error));
+}
+
+TEST_CASE("error location") {
+    using Catch::Matchers::Equals;
+    tecalc::calculator calc;
+    calc.bind_var("v", 1).bind_fn("f", [](int x){ return x; }).bind_fn("g", []{ return 42; });
+    auto loc = [&](std::string_view expr) {
+        std::error_code ec;
+        REQUIRE(calc.eval(expr, ec) == std::nullopt);
+        const auto& el = calc.last_error_location();
+        return std::make_pair(el.offset, el.length);
+    };
+    using loc_type = std::pair<size_t, size_t>;
+    CHECK(loc("1 + 0x8FG + 2") == loc_type{4, 5});
+    CHECK(loc("1 + und * 2") == loc_type{4, 3});
+    CHECK(loc("v + und(1)") == loc_type{4, 3});
+    CHECK(loc("2 * f(1, 2)") == loc_type{4, 7});
+    CHECK(loc("1 + 4 / 0 ") == loc_type{6, 3});
+    CHECK(loc("1 + v(1)") == loc_type{5, 1});
+    CHECK(loc("1 + f + 2") == loc_type{4, 1});
+    CHECK(loc("1 2") == loc_type{2, 0});
+    CHECK(loc("(1 + 2") == loc_type{6, 0});
+    CHECK(loc("g(") == loc_type{2, 0});
+    CHECK(loc("g(  ") == loc_type{4, 0});
+    CHECK(loc("1 + f(") == loc_type{6, 0});
+    // unterminated/malformed argument list
+    std::error_code ec;
+    REQUIRE(calc.eval("f(1", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("f(", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("g(", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("1+g(  ", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("f(,1)", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("f(1 2)", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    REQUIRE(calc.eval("f(1)+", ec) == std::nullopt); CHECK(ec.value() == syntax_error);
+    // tecalc_error::what() includes error location
+    try {
+        calc.eval("v + und");
+        FAIL("tecalc_error not thrown");
+    } catch (const tecalc::tecalc_error& e) {
+        CHECK(e.location().offset == 4);
+        CHECK(e.location().length == 3);
+        REQUIRE_THAT(e.what(), Equals("Unknown identifier at offset 4 (length 3)"));
+    }
+}
+
+TEST_CASE("tracing policy") {
+    using Catch::Matchers::Equals;
+    using log_type = std::vector<std::string>;
+    tecalc::basic_calculator<int, 2, recording_tracer> calc;
+    calc.bind_var("x", 3).bind_fn("add", [](int a, int b){ return a + b; });
+    REQUIRE(calc.eval("add(x, 1) * -2 + 7 % 4") == -5);
+    REQUIRE_THAT(calc.tracer().log, Equals(log_type{
+        "x=3", "add#2=4", "-2=-2", "4*-2=-8", "7%4=3", "-8+3=-5"}));
+    calc.tracer().log.clear();
+    std::error_code ec;
+    REQUIRE(calc.eval("x / 0", ec) == std::nullopt);
+    REQUIRE_THAT(calc.tracer().log, Equals(log_type{"x=3", "error5@2"}));
+    // default tracer has no state, and occupies no space in calculator
+    static_assert(std::is_empty_v<tecalc::null_tracer>);
+    static_assert(std::is_same_v<tecalc::calculator::tracer_type, tecalc::null_tracer>);
+    struct final_tracer final : tecalc::null_tracer {};     // stored as member
+    static_assert(sizeof(tecalc::calculator) < sizeof(tecalc::basic_calculator<int, 2, final_tracer>));
+    tecalc::basic_calculator<int, 2, final_tracer> final_calc;
+    REQUIRE(final_calc.eval("1 + 2") == 3);
+}
+
+TEST_CASE("metrics") {
+    using Catch::Matchers::Contains;
+    // latency histogram
+    tecalc::latency_histogram h;
+    for (std::uint64_t v = 1; v <= 1000; ++v) {
+        h.record(v);
+    }
+    CHECK(h.count() == 1000);
+    CHECK(h.sum() == 500500);
+    CHECK(h.max() == 1000);
+    CHECK(h.count_below(64) == 63);
+    CHECK(h.count_below(1024) == 1000);
+    CHECK(h.count_at_most(63) == 63);
+    CHECK(h.percentile(0.5) >= 500);
+    CHECK(h.percentile(0.5) <= 500 + 500 / tecalc::latency_histogram::kSubCount);
+    CHECK(h.percentile(1.0) == 1000);
+    for (int i = 1; i < tecalc::latency_histogram::kBucketCount; ++i) {
+        auto lb = tecalc::latency_histogram::lower_bound(i);
+        REQUIRE(tecalc::latency_histogram::index_of(lb) == i);
+        REQUIRE(tecalc::latency_histogram::index_of(lb - 1) == i - 1);
+    }
+    // metrics tracer
+    tecalc::basic_calculator<int, 2, tecalc::metrics_tracer> calc;
+    calc.bind_var("x", 2).bind_fn("neg", [](int n){ return -n; });
+    REQUIRE(calc.eval("x * 3 + neg(x)") == 4);
+    REQUIRE(calc.eval("-neg(1)") == 1);
+    std::error_code ec;
+    REQUIRE(calc.eval("x / 0", ec) == std::nullopt);
+    REQUIRE(calc.eval("und", ec) == std::nullopt);
+    const auto& m = calc.tracer().snapshot();
+    CHECK(m.evaluations == 4);
+    CHECK(m.operators == 3);
+    CHECK(m.variable_lookups == 3);
+    CHECK(m.errors.at(tecalc::errc::divide_by_zero) == 1);
+    CHECK(m.errors.at(tecalc::errc::unknown_identifier) == 1);
+    REQUIRE(m.function("neg") != nullptr);
+    CHECK(m.function("neg")->calls == 2);
+    CHECK(m.function("und") == nullptr);
+    CHECK(m.eval_latency.count() == 4);
+    // merge/dump
+    tecalc::metrics_snapshot total;
+    total.merge(m);
+    total.merge(m);
+    CHECK(total.evaluations == 8);
+    CHECK(total.function("neg")->calls == 4);
+    std::ostringstream ss;
+    tecalc::write_prometheus(ss, total);
+    const std::string text = ss.str();
+    CHECK_THAT(text, Contains("tecalc_evaluations_total 8\n"));
+    CHECK_THAT(text, Contains("tecalc_errors_total{errc=\"divide_by_zero\"} 2\n"));
+    CHECK_THAT(text, Contains("tecalc_function_calls_total{function=\"neg\"} 4\n"));
+    CHECK_THAT(text, Contains("tecalc_eval_duration_seconds_bucket{le=\"+Inf\"} 8\n"));
+    CHECK_THAT(text, Contains("tecalc_eval_duration_seconds_count 8\n"));
+    // 'le' bucket includes sample on its boundary
+    tecalc::metrics_snapshot boundary;
+    boundary.eval_latency.record(63);
+    boundary.eval_latency.record(64);
+    boundary.eval_latency.record(127);
+    ss.str("");
+    tecalc::write_prometheus(ss, boundary);
+    CHECK_THAT(ss.str(), Contains("tecalc_eval_duration_seconds_bucket{le=\"6.3e-08\"} 1\n"));
+    CHECK_THAT(ss.str(), Contains("tecalc_eval_duration_seconds_bucket{le=\"1.27e-07\"} 3\n"));
+    CHECK_THAT(ss.str(), Contains("tecalc_eval_duration_seconds_bucket{le=\"2.55e-07\"} 3\n"));
+    calc.tracer().reset();
+    CHECK(calc.tracer().snapshot().evaluations == 0);
+    // per-function statistics
+    calc.bind_fn("at", [](int i) -> tecalc::eval_result<int> {
+        if (i < 0) return {0, tecalc::errc::function_error};
+        return {i};
+    });
+    REQUIRE(calc.eval("at(1) + at(2) + neg(3)") == 0);
+    REQUIRE(calc.eval("at(-1)", ec) == std::nullopt);
+    REQUIRE(calc.eval("at(1, 2)", ec) == std::nullopt);
+    REQUIRE(calc.eval("neg()", ec) == std::nullopt);
+    const auto* at = calc.tracer().snapshot().function("at");
+    REQUIRE(at != nullptr);
+    CHECK(at->calls == 3);
+    CHECK(at->errors == 1);
+    CHECK(at->arg_num_mismatches == 1);
+    CHECK(at->max_ns <= at->total_ns);
+    const auto* fneg = calc.tracer().snapshot().function("neg");
+    CHECK(fneg->calls == 1);
+    CHECK(fneg->arg_num_mismatches == 1);
+    // disable function timing
+    tecalc::basic_calculator<int, 2, tecalc::metrics_tracer> calc2{tecalc::metrics_tracer{false}};
+    calc2.bind_fn("one", []{ return 1; });
+    REQUIRE(calc2.eval("one()") == 1);
+    CHECK(calc2.tracer().snapshot().function("one")->calls == 1);
+    CHECK(calc2.tracer().snapshot().function("one")->total_ns == 0);
+}
+
+TEST_CASE("sampling profiler") {
+    using Catch::Matchers::Contains;
+    tecalc::basic_calculator<int, 2, tecalc::sampling_profiler> calc{tecalc::sampling_profiler{2, 2}};
+    CHECK(calc.tracer().sample_interval() == 2);
+    std::error_code ec;
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(calc.eval("1 + 2") == 3);
+        REQUIRE(calc.eval("3 * 4") == 12);
+        REQUIRE(calc.eval("3 / 0", ec) == std::nullopt);
+    }
+    // 1-in-2 evaluations are sampled on average, and only 2 expressions are tracked
+    auto top = calc.tracer().top(5);
+    REQUIRE(top.size() == 2);
+    std::uint64_t samples = top[0].samples + top[1].samples + calc.tracer().untracked_samples();
+    CHECK(1300 <= samples);
+    CHECK(samples <= 1700);
+    CHECK(top[0].total_ns >= top[1].total_ns);
+    CHECK(300 <= calc.tracer().untracked_samples());
+    for (const auto& e : top) {
+        // no expression is skipped by aliasing with period of workload
+        CHECK(300 <= e.samples);
+        CHECK(e.errors == (e.expr == "3 / 0" ? e.samples : 0));
+    }
+    std::ostringstream ss;
+    calc.tracer().write_report(ss, 1);
+    CHECK_THAT(ss.str(), Contains("expression"));
+    CHECK_THAT(ss.str(), Contains("samples of untracked expressions"));
+    calc.tracer().reset();
+    CHECK(calc.tracer().top(5).empty());
+    // every evaluation is sampled with interval 1
+    tecalc::basic_calculator<int, 2, tecalc::sampling_profiler> calc1{tecalc::sampling_profiler{1}};
+    for (int i = 0; i < 10; ++i) {
+        REQUIRE(calc1.eval("1 + 2") == 3);
+    }
+    REQUIRE(calc1.tracer().top(5).size() == 1);
+    CHECK(calc1.tracer().top(5)[0].samples == 10);
+}
+
+TEST_CASE("workload capture/replay") {
+    std::stringstream ss;
+    {
+        tecalc::basic_calculator<int, 2, tecalc::workload_recorder<int>> calc;
+        calc.bind_var("a", 1).bind_var("b", 2).bind_fn("neg", [](int x){ return -x; });
+        calc.tracer().start(ss, calc.variables(), calc.functions());  // snapshot a, b, neg
+        calc.bind_fn("twice", [](int x){ return x * 2; });
+        REQUIRE(calc.eval("a + b") == 3);
+        calc.bind_var("a", 10);                     // delta
+        REQUIRE(calc.eval("twice(a) - b") == 18);
+        std::error_code ec;
+        REQUIRE(calc.eval("b / 0", ec) == std::nullopt);
+        calc.tracer().stop();
+        REQUIRE(calc.eval("a") == 10);              // not recorded
+    }
+    std::vector<tecalc::workload_record<int>> records;
+    REQUIRE(tecalc::read_workload(ss, records));
+    REQUIRE(records.size() == 8);
+    CHECK(records[0].tag == tecalc::workload_tag::bind_var);
+    CHECK(records[2].tag == tecalc::workload_tag::bind_fn);
+    CHECK(records[2].text == "neg");
+    CHECK(records[3].tag == tecalc::workload_tag::bind_fn);
+    CHECK(records[4].tag == tecalc::workload_tag::eval);
+    CHECK(records[4].text == "a + b");
+    CHECK(records[4].value == 3);
+    CHECK(static_cast<int>(records[7].ec) == divide_by_zero);
+    // replay with same function
+    tecalc::calculator calc;
+    calc.bind_fn("twice", [](int x){ return x * 2; });
+    auto report = tecalc::replay(records, calc);
+    CHECK(report.evaluations == 3);
+    CHECK(report.bindings == 3);
+    CHECK(report.mismatches == 0);
+    CHECK(report.unbound == 0);
+    REQUIRE(report.functions.size() == 2);
+    CHECK(report.functions[0] == "neg");
+    CHECK(report.functions[1] == "twice");
+    // replay with different function
+    tecalc::calculator calc2;
+    calc2.bind_fn("twice", [](int x){ return x * 3; });
+    report = tecalc::replay(records, calc2);
+    REQUIRE(report.mismatches == 1);
+    CHECK(report.first_mismatches[0].expr == "twice(a) - b");
+    CHECK(report.first_mismatches[0].expected == 18);
+    CHECK(report.first_mismatches[0].actual == 28);
+    // bindings before start() are lost without snapshot
+    std::stringstream unbound_workload;
+    {
+        tecalc::basic_calculator<int, 2, tecalc::workload_recorder<int>> calc3;
+        calc3.bind_var("c", 1);
+        calc3.tracer().start(unbound_workload);
+        REQUIRE(calc3.eval("c + 1") == 2);
+    }
+    records.clear();
+    REQUIRE(tecalc::read_workload(unbound_workload, records));
+    tecalc::calculator calc3;
+    report = tecalc::replay(records, calc3);
+    CHECK(report.mismatches == 1);
+    CHECK(report.unbound == 1);
+    // broken workload
+    std::stringstream broken{"TCWL"};
+    records.clear();
+    CHECK_FALSE(tecalc::read_workload(broken, records));
+    std::stringstream ll_workload;
+    tecalc::workload_recorder<long long>{}.start(ll_workload);
+    CHECK_FALSE(tecalc::read_workload(ll_workload, records));
+    std::stringstream truncated;
+    tecalc::workload_recorder<int>{}.start(truncated);
+    truncated << static_cast<char>(tecalc::workload_tag::eval) << std::string("\xff\xff\xff\x7f", 4) << "1 + 2";
+    CHECK_FALSE(tecalc::read_workload(truncated, records));
+}
+
+TEST_CASE("streaming evaluation") {
+    using calc_type = tecalc::basic_calculator<int, 2, recording_tracer>;
+    calc_type calc;
+    calc.bind_var("x", 3).bind_var("zero", 0)
+        .bind_fn("add", [](int a, int b){ return a + b; })
+        .bind_fn("neg", [](int a){ return -a; })
+        .bind_fn("one", []{ return 1; })
+        .bind_fn("fail", [](int a){ return tecalc::eval_result<int>{a, tecalc::errc::function_error}; });
+    // stream evaluation of any chunking matches eval()
+    const char* exprs[] = {
+        "add(x, 1) * -2 + 7 % 4", "((1 + 2) * (3 - x)) / 2", " - -x * --3 ", "neg(add(1, 2)) - one()",
+        "0x1F + 0b101 - 1234567", "((((x))))", "2 * (x + 1) * 3 - 4 / 2", "one( ) + neg (x)",
+        "", "1 +", "1 2", "(1 + 2", "1 + 2)", "1 + 0x8FG + 2", "1 + und * 2", "x + und(1)",
+        "2 * add(1)", "1 + 4 / 0 ", "1 + x(1)", "1 + add + 2", "add(1", "add(,1)", "add(1 2)",
+        "add(1)+", "x / zero", "fail(2) + 1", "one(", "neg(  ", "(1, 2)", "1 $ 2", "12ab",
+        "2 / 0 (1)", "-(1)(2)", "((1)(2))", "one()(1)", "0x-1",
+        "1.5", "2 / 0.5", "1 + 2.", "3 * 1.2.3", "12.ab",
+    };
+    for (std::string_view expr : exprs) {
+        calc.tracer().log.clear();
+        auto expected = calc.try_eval(expr);
+        auto expected_loc = calc.last_error_location();
+        auto expected_log = calc.tracer().log;
+        for (std::size_t chunk : {1, 2, 3, 7, 100}) {
+            INFO("expr=\"" << expr << "\" chunk=" << chunk);
+            calc.tracer().log.clear();
+            tecalc::stream_evaluator<calc_type> s{calc};
+            for (std::size_t pos = 0; pos < expr.size(); pos += chunk) {
+                s.feed(expr.substr(pos, chunk));
+            }
+            auto r = s.try_finish();
+            CHECK(r.ec == expected.ec);
+            if (r) {
+                CHECK(r.value == expected.value);
+            } else {
+                CHECK(calc.last_error_location().offset == expected_loc.offset);
+                CHECK(calc.last_error_location().length == expected_loc.length);
+            }
+            CHECK(calc.tracer().log == expected_log);
+        }
+    }
+    // error is detected while feeding, and reported by finish()
+    tecalc::stream_evaluator<calc_type> s{calc};
+    CHECK(s.feed("1 + (2 "));
+    CHECK_FALSE(s.feed(") * zero) + 3"));
+    CHECK(s.failed());
+    std::error_code ec;
+    CHECK(s.finish(ec) == std::nullopt);
+    CHECK(ec.value() == syntax_error);
+    CHECK_THROWS_MATCHES(s.finish(), tecalc::tecalc_error, IsErrc(tecalc::errc::syntax_error));
+    // reset for next expression
+    s.reset();
+    calc.tracer().evals.clear();
+    CHECK(s.feed("4"));
+    CHECK(s.feed("2 % 5"));
+    CHECK(s.offset() == 6);
+    CHECK(s.finish() == 2);
+    // eval hooks are called once per expression, and on_eval_end receives fed text
+    CHECK_THAT(calc.tracer().evals, Catch::Matchers::Equals(std::vector<std::string>{"begin:", "end:42 % 5=2"}));
+}
+
+TEST_CASE("incremental evaluation") {
+    using calc_type = tecalc::basic_calculator<int, 2, recording_tracer>;
+    calc_type calc;
+    calc.bind_var("x", 3).bind_fn("add", [](int a, int b){ return a + b; });
+    tecalc::incremental_evaluator<calc_type> inc{calc, 8};
+    std::string text;
+    for (int i = 0; i < 20; ++i) {
+        text += "add(x, " + std::to_string(i) + ") * 2 - (x + 1) + ";
+    }
+    text += "7";
+    inc.assign(text);
+    auto check = [&]{
+        auto expected = calc.try_eval(inc.text());
+        auto expected_loc = calc.last_error_location();
+        auto r = inc.try_eval();
+        REQUIRE(r.ec == expected.ec);
+        if (r) {
+            CHECK(r.value == expected.value);
+        } else {
+            CHECK(calc.last_error_location().offset == expected_loc.offset);
+            CHECK(calc.last_error_location().length == expected_loc.length);
+        }
+    };
+    check();
+    CHECK(inc.reused() == 0);
+    // eval hooks are called once per try_eval() with whole text
+    calc.tracer().evals.clear();
+    inc.try_eval();
+    inc.try_eval();
+    const std::string end = "end:" + text + "=" + std::to_string(calc.eval(text));
+    CHECK_THAT(calc.tracer().evals, Catch::Matchers::Equals(std::vector<std::string>{
+        "begin:" + text, end, "begin:" + text, end, "begin:" + text, end}));
+    // edit near the end reuses evaluation of prefix
+    inc.edit(text.size() - 1, 1, "42");
+    check();
+    CHECK(inc.reused() >= text.size() - 8);
+    inc.edit(100, 0, "1 + ");
+    check();
+    CHECK(inc.reused() == 96);
+    // errors, and their recovery
+    inc.edit(50, 0, ")");
+    check();
+    inc.edit(200, 1, "zz");
+    check();
+    inc.edit(50, 1, "");
+    check();
+    inc.edit(0, 0, "1 / (x - 3) + ");
+    check();
+    inc.edit(0, 14, "");
+    check();
+    // bindings change
+    calc.bind_var("x", 5);
+    inc.invalidate();
+    check();
+    CHECK(inc.reused() == 0);
+    CHECK_THROWS_AS(inc.edit(inc.text().size() + 1, 0, "1"), std::out_of_range);
 }
 
 TEST_CASE("README example") {
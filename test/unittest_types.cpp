@@ -0,0 +1,187 @@
+/*
+ * unittest.cpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+// Second translation unit of unittest; it checks that tecalc.hpp can be
+// included from multiple TUs, and covers the explicitly instantiated
+// value types of tecalc_lib (src/tecalc.cpp).
+#include <string>
+#include <catch2/catch.hpp>
+#include "tecalc.hpp"
+#include "tecalc_decimal.hpp"
+#include "tecalc_stream.hpp"
+
+TEST_CASE("value types") {
+    SECTION("long long") {
+        tecalc::basic_calculator<long long> calc;
+        calc.bind_var("G", 1000000000);
+        calc.bind_fn("sq", [](long long x){ return x * x; });
+        CHECK(calc.eval("sq(G) * 8") == 8000000000000000000LL);
+        CHECK(calc.eval("0x7fffffffffffffff") == 9223372036854775807LL);
+        CHECK(calc.eval("-7 % 3") == -1);
+        CHECK(calc.eval("-9223372036854775807 / 3") == -3074457345618258602LL);
+        std::error_code ec;
+        CHECK(calc.eval("9223372036854775808", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+    }
+#if defined(TECALC_HAS_INT128)
+    SECTION("128-bit integer") {
+        using tecalc::int128_t;
+        tecalc::basic_calculator<int128_t> calc;
+        const int128_t e18 = 1000000000000000000LL;
+        calc.bind_var("N", e18);
+        calc.bind_fn("sq", [](int128_t x){ return x * x; });
+        CHECK(calc.eval("sq(N)") == e18 * e18);
+        CHECK(calc.eval("sq(N) / N + 1") == e18 + 1);
+        CHECK(calc.eval("sq(N) % 7") == (e18 * e18) % 7);
+        CHECK(calc.eval("-7 % 3") == -1);
+        CHECK(calc.eval("-9223372036854775807 - 1") == -int128_t{9223372036854775807LL} - 1);
+        CHECK(calc.eval("(-9223372036854775807 - 1) / -1") == int128_t{9223372036854775807LL} + 1);
+        // literals beyond 64-bit
+        CHECK(calc.eval("1000000000000000000000000000000") == e18 * 1000000000000LL);
+        const int128_t max = static_cast<int128_t>(~tecalc::uint128_t{0} >> 1);
+        CHECK(calc.eval("170141183460469231731687303715884105727") == max);
+        CHECK(calc.eval("0x7fffffffffffffffffffffffffffffff") == max);
+        CHECK(calc.eval("0b1" + std::string(126, '0')) == int128_t{1} << 126);
+        std::error_code ec;
+        CHECK(calc.eval("170141183460469231731687303715884105728", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+        CHECK(calc.eval("0x1" + std::string(32, '0'), ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+        CHECK(calc.eval("12ab", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+        CHECK(calc.eval("N / 0", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::divide_by_zero);
+    }
+#endif
+    SECTION("double") {
+        tecalc::basic_calculator<double> calc;
+        calc.bind_var("x", 3);
+        calc.bind_fn("half", [](double v){ return v / 2; });
+        CHECK(calc.eval("1 / 4") == 0.25);
+        CHECK(calc.eval("half(x) * 2 + 0x10 - 0b11") == 16.0);
+        CHECK(calc.eval("7 % 4") == 3.0);
+        CHECK(calc.eval("100000000000000000000") == 1e20);
+        std::error_code ec;
+        CHECK(calc.eval("1 / 0", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::divide_by_zero);
+        CHECK(calc.eval("12ab", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+    }
+}
+
+TEST_CASE("decimal value type") {
+    using dec6 = tecalc::decimal<6>;
+    SECTION("arithmetic") {
+        tecalc::basic_calculator<dec6> calc;
+        calc.bind_var("rate", dec6::from_raw(35000));   // 0.035
+        calc.bind_fn("max", [](dec6 a, dec6 b){ return a < b ? b : a; });
+        CHECK(calc.eval("0.1 + 0.2") == dec6::from_raw(300000));
+        CHECK(calc.eval("1250.75 * (1 + rate)") == dec6::from_raw(1294526250));
+        CHECK(calc.eval("max(-1.5, 0x10)") == 16);
+        CHECK(calc.eval("10 / 4") == dec6::from_raw(2500000));
+        CHECK(calc.eval("7.5 % 2") == dec6::from_raw(1500000));
+        CHECK(calc.eval("-7.5 % 2") == dec6::from_raw(-1500000));
+        CHECK(calc.eval("9223372036854.775807") == dec6::from_raw(9223372036854775807LL));
+        CHECK(calc.eval("1.5").to_string() == "1.500000");
+        CHECK(calc.eval("-0.000042").to_string() == "-0.000042");
+        std::error_code ec;
+        CHECK(calc.eval("1 / 0.0", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::divide_by_zero);
+        CHECK(calc.eval("9223372036854.775808", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+        CHECK(calc.eval("1.5e3", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::invalid_literal);
+        CHECK(calc.last_error_location().length == 5);
+        CHECK(calc.eval("1.", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::syntax_error);
+        CHECK(calc.eval("0x1.8", ec) == std::nullopt);
+        CHECK(ec == tecalc::errc::syntax_error);
+    }
+    SECTION("rounding") {
+        using even = tecalc::decimal<2, std::int64_t, tecalc::rounding::half_even>;
+        using up = tecalc::decimal<2, std::int64_t, tecalc::rounding::half_up>;
+        using trunc = tecalc::decimal<2, std::int64_t, tecalc::rounding::toward_zero>;
+        using away = tecalc::decimal<2, std::int64_t, tecalc::rounding::away_from_zero>;
+        CHECK(tecalc::basic_calculator<even>{}.eval("0.125 + 0.135") == even::from_raw(26));
+        CHECK(tecalc::basic_calculator<up>{}.eval("0.125 + 0.135") == up::from_raw(27));
+        CHECK(tecalc::basic_calculator<even>{}.eval("1 / 8") == even::from_raw(12));
+        CHECK(tecalc::basic_calculator<up>{}.eval("-1 / 8") == up::from_raw(-13));
+        CHECK(tecalc::basic_calculator<trunc>{}.eval("2 / 3") == trunc::from_raw(66));
+        CHECK(tecalc::basic_calculator<away>{}.eval("-2 / 3") == away::from_raw(-67));
+        CHECK(tecalc::basic_calculator<away>{}.eval("2 / 300") == away::from_raw(1));
+        // literal rounding commutes with unary minus
+        CHECK(tecalc::basic_calculator<up>{}.eval("-1.005") == up::from_raw(-101));
+        CHECK(tecalc::basic_calculator<even>{}.eval("-1.005") == even::from_raw(-100));
+        CHECK(tecalc::basic_calculator<trunc>{}.eval("-1.009") == trunc::from_raw(-100));
+        CHECK(tecalc::basic_calculator<away>{}.eval("-1.001") == away::from_raw(-101));
+        CHECK(tecalc::basic_calculator<even>{}.eval("0.05 * 0.5") == even::from_raw(2));
+        CHECK(tecalc::basic_calculator<up>{}.eval("0.05 * 0.5") == up::from_raw(3));
+        CHECK(tecalc::basic_calculator<even>{}.eval("0.015000001") == even::from_raw(2));
+    }
+#if defined(TECALC_HAS_INT128)
+    SECTION("128-bit storage") {
+        using dec18 = tecalc::decimal<18, tecalc::int128_t>;
+        tecalc::basic_calculator<dec18> calc;
+        CHECK(calc.eval("1 / 3").to_string() == "0.333333333333333333");
+        CHECK(calc.eval("2 / 3").to_string() == "0.666666666666666667");
+        CHECK(calc.eval("123456789.123456789 * 1000000") == dec18::from_raw(tecalc::int128_t{123456789123456789} * 1000000000000000));
+        CHECK(calc.eval("10000000000000000000 / 0.5").to_string() == "20000000000000000000.000000000000000000");
+        CHECK(calc.eval("1999 / 1000").to_string() == "1.999000000000000000");
+        CHECK(calc.eval("2000 / 999").to_string() == "2.002002002002002002");
+        CHECK(calc.eval("-1999.5 / 1000.3").to_string() == "-1.998900329901029691");
+        CHECK(calc.eval("-1000 / 998").to_string() == "-1.002004008016032064");
+        CHECK(calc.eval("1 / 100000000000000000000").to_string() == "0.000000000000000000");
+        CHECK(calc.eval("1 / 3 * 3 - 1") == dec18::from_raw(-1));
+    }
+#endif
+    SECTION("stream evaluation") {
+        tecalc::basic_calculator<dec6> calc;
+        for (std::string_view expr : {"1.25 * 4", "0.1 + 2.5 / 3", "1.5.2", "3. + 1", "1.5x"}) {
+            auto expected = calc.try_eval(expr);
+            auto expected_loc = calc.last_error_location();
+            tecalc::stream_evaluator<tecalc::basic_calculator<dec6>> s{calc};
+            for (char c : expr) {
+                s.feed(std::string_view{&c, 1});
+            }
+            auto r = s.try_finish();
+            INFO("expr=\"" << expr << "\"");
+            CHECK(r.ec == expected.ec);
+            if (r) {
+                CHECK(r.value == expected.value);
+            } else {
+                CHECK(calc.last_error_location().offset == expected_loc.offset);
+                CHECK(calc.last_error_location().length == expected_loc.length);
+            }
+        }
+    }
+}
+
+TEST_CASE("error_code conversion") {
+    std::error_code ec = tecalc::errc::syntax_error;
+    CHECK(ec == make_error_code(tecalc::errc::syntax_error));
+    CHECK(ec == std::make_error_code(tecalc::errc::syntax_error));
+    CHECK(ec.category() == tecalc::tecalc_category());
+    CHECK(ec != tecalc::errc::invalid_literal);
+}
@@ -0,0 +1,155 @@
+/*
+ * batch.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_BATCH_HPP_INCLUDED_
+#define TECALC_TOOLS_BATCH_HPP_INCLUDED_
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tecalc.hpp"
+
+
+namespace tools {
+
+// number of evaluated lines (or rows) and errors
+struct batch_stats {
+    std::size_t lines = 0;
+    std::size_t errors = 0;
+
+    batch_stats& operator+=(const batch_stats& rhs) noexcept
+    {
+        lines += rhs.lines;
+        errors += rhs.errors;
+        return *this;
+    }
+};
+
+// remove and return the first chunk of text of about chunk_size bytes,
+// which ends at line boundary
+inline std::string_view next_chunk(std::string_view& text, std::size_t chunk_size) noexcept
+{
+    std::size_t n = text.size();
+    if (chunk_size < n) {
+        std::size_t eol = text.find('\n', chunk_size - 1);
+        if (eol != std::string_view::npos) n = eol + 1;
+    }
+    std::string_view chunk = text.substr(0, n);
+    text.remove_prefix(n);
+    return chunk;
+}
+
+// read one byte of each page to fault in memory-mapped chunk
+inline void touch_pages(std::string_view chunk) noexcept
+{
+    constexpr std::size_t page_size = 4096;
+    volatile char sink = 0;
+    for (std::size_t i = 0; i < chunk.size(); i += page_size) {
+        sink = sink + chunk[i];
+    }
+}
+
+// remove and return the first line of text (without "\n" or "\r\n")
+inline std::string_view next_line(std::string_view& text) noexcept
+{
+    std::size_t eol = text.find('\n');
+    std::string_view line = text.substr(0, eol);
+    text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return line;
+}
+
+inline bool is_blank(std::string_view line) noexcept
+{
+    return line.find_first_not_of(" \t") == std::string_view::npos;
+}
+
+// status of each input row, other than evaluation error
+enum class row_status : unsigned char {
+    ok,
+    blank,
+    invalid_field,
+    field_count_mismatch,
+};
+
+template <class Value>
+void append_value(std::string& out, Value v)
+{
+    char buf[64];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr);
+}
+
+// result sink which formats one text line for each row
+//   Sink receives value(), error(), row_error() or blank() for each row.
+template <class Value>
+struct text_sink {
+    std::string out;
+
+    void clear() noexcept { out.clear(); }
+    void value(Value v)
+    {
+        append_value(out, v);
+        out += '\n';
+    }
+    void error(tecalc::errc ec, const tecalc::error_location& loc)
+    {
+        out += "error: ";
+        out += tecalc::tecalc_error(ec, loc).what();
+        out += '\n';
+    }
+    void row_error(row_status st)
+    {
+        out += (st == row_status::invalid_field) ? "error: Invalid field\n"
+                                                 : "error: Number of fields mismatch\n";
+    }
+    void blank() { out += '\n'; }
+};
+
+// evaluate each line of chunk as expression, and put the result into sink
+template <class Calc, class Sink>
+batch_stats eval_lines(Calc& calc, std::string_view chunk, Sink& sink)
+{
+    batch_stats stats;
+    while (!chunk.empty()) {
+        std::string_view line = next_line(chunk);
+        if (is_blank(line)) {
+            sink.blank();
+        } else if (auto r = calc.try_eval(line)) {
+            sink.value(r.value);
+        } else {
+            sink.error(r.ec, calc.last_error_location());
+            ++stats.errors;
+        }
+        ++stats.lines;
+    }
+    return stats;
+}
+
+} // namespace tools
+
+#endif
@@ -0,0 +1,369 @@
+/*
+ * columnar.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_COLUMNAR_HPP_INCLUDED_
+#define TECALC_TOOLS_COLUMNAR_HPP_INCLUDED_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "batch.hpp"
+#include "csv.hpp"
+
+
+//
+// Columnar file format (all integers are little-endian)
+//
+//   offset size
+//   0      4    magic "TCCF"
+//   4      1    version (1)
+//   5      3    reserved (0)
+//   8      4    number of columns
+//   12     4    reserved (0)
+//   16     8    number of rows
+//   24     -    column entries, each of them is
+//                 1  type (1=int32, 2=int64, 3=float64)
+//                 3  reserved (0)
+//                 4  name length
+//                 8  offset of column block from beginning of file
+//                 -  name, padded with 0 to multiple of 8 bytes
+//   column blocks of (number of rows * size of type) bytes, 64-byte aligned
+//
+namespace tools {
+
+enum class column_type : std::uint8_t {
+    int32 = 1,
+    int64 = 2,
+    float64 = 3,
+};
+
+inline std::size_t column_type_size(column_type t) noexcept
+{
+    return t == column_type::int32 ? 4 : 8;
+}
+
+// column type which stores Value
+template <class Value>
+constexpr column_type column_type_of() noexcept
+{
+    static_assert((std::is_integral_v<Value> && (sizeof(Value) == 4 || sizeof(Value) == 8))
+                  || (std::is_floating_point_v<Value> && sizeof(Value) == 8),
+                  "unsupported value type for columnar format");
+    if constexpr (std::is_floating_point_v<Value>) {
+        return column_type::float64;
+    } else {
+        return sizeof(Value) == 4 ? column_type::int32 : column_type::int64;
+    }
+}
+
+namespace impl {
+
+constexpr char kColumnarMagic[4] = {'T', 'C', 'C', 'F'};
+constexpr std::uint8_t kColumnarVersion = 1;
+constexpr std::size_t kColumnarAlign = 64;
+
+inline std::uint64_t load_le(const char* p, std::size_t n) noexcept
+{
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        v |= std::uint64_t{static_cast<unsigned char>(p[i])} << (8 * i);
+    }
+    return v;
+}
+
+inline void store_le(std::string& buf, std::uint64_t v, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        buf += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+template <class T>
+constexpr T align_up(T n, std::size_t a) noexcept
+{
+    return static_cast<T>((n + a - 1) / a * a);
+}
+
+} // namespace impl
+
+inline bool is_columnar(std::string_view bytes) noexcept
+{
+    return 4 <= bytes.size() && std::memcmp(bytes.data(), impl::kColumnarMagic, 4) == 0;
+}
+
+// column of columnar file
+struct columnar_column {
+    std::string name;
+    column_type type;
+    const char* data;       // beginning of column block
+};
+
+// reader of columnar file image (e.g. mapped_file::view())
+class columnar_reader {
+public:
+    // parse header, return false if bytes is not valid columnar file
+    bool open(std::string_view bytes)
+    {
+        columns_.clear();
+        rows_ = 0;
+        if (bytes.size() < 24 || !is_columnar(bytes) || bytes[4] != impl::kColumnarVersion) return false;
+        const char* base = bytes.data();
+        std::uint64_t ncols = impl::load_le(base + 8, 4);
+        std::uint64_t rows = impl::load_le(base + 16, 8);
+        std::size_t pos = 24;
+        for (std::uint64_t i = 0; i < ncols; ++i) {
+            if (bytes.size() < pos + 16) return false;
+            auto type = static_cast<column_type>(base[pos]);
+            std::uint64_t name_len = impl::load_le(base + pos + 4, 4);
+            std::uint64_t offset = impl::load_le(base + pos + 8, 8);
+            pos += 16;
+            if (type != column_type::int32 && type != column_type::int64 && type != column_type::float64) return false;
+            if (bytes.size() - pos < name_len) return false;
+            std::size_t block = column_type_size(type);
+            if (offset % impl::kColumnarAlign != 0 || bytes.size() < offset
+                || (bytes.size() - offset) / block < rows) return false;
+            columns_.push_back({std::string{base + pos, static_cast<std::size_t>(name_len)}, type, base + offset});
+            pos += impl::align_up(static_cast<std::size_t>(name_len), 8);
+        }
+        rows_ = static_cast<std::size_t>(rows);
+        return true;
+    }
+
+    std::size_t rows() const noexcept { return rows_; }
+    const std::vector<columnar_column>& columns() const noexcept { return columns_; }
+
+    // pointer to rows [first, ...) of column as Value, if it can be used without conversion
+    template <class Value>
+    const Value* direct(std::size_t col, std::size_t first) const noexcept
+    {
+        const auto& c = columns_[col];
+        if (c.type != column_type_of<Value>() || !impl::is_little_endian()) return nullptr;
+        return reinterpret_cast<const Value*>(c.data) + first;
+    }
+
+    // convert rows [first, first + count) of column to Value
+    //   Rows whose value is out of range of Value are marked as invalid_field in status.
+    template <class Value>
+    void load(std::size_t col, std::size_t first, std::size_t count, std::vector<Value>& out,
+              std::vector<row_status>& status) const
+    {
+        const auto& c = columns_[col];
+        const std::size_t size = column_type_size(c.type);
+        const char* p = c.data + first * size;
+        out.resize(count);
+        for (std::size_t i = 0; i < count; ++i, p += size) {
+            std::uint64_t bits = impl::load_le(p, size);
+            switch (c.type) {
+            case column_type::int32:
+                out[i] = static_cast<Value>(static_cast<std::int32_t>(static_cast<std::uint32_t>(bits)));
+                break;
+            case column_type::int64:
+                out[i] = static_cast<Value>(static_cast<std::int64_t>(bits));
+                break;
+            case column_type::float64: {
+                double d;
+                std::memcpy(&d, &bits, sizeof(d));
+                if constexpr (std::is_integral_v<Value>) {
+                    // -min is exactly representable as double, unlike max
+                    constexpr auto lo = static_cast<double>(std::numeric_limits<Value>::min());
+                    if (!(lo <= d && d < -lo)) {
+                        out[i] = Value{};
+                        status[i] = row_status::invalid_field;
+                        break;
+                    }
+                }
+                out[i] = static_cast<Value>(d);
+                break;
+            }
+            }
+        }
+    }
+
+private:
+    std::vector<columnar_column> columns_;
+    std::size_t rows_ = 0;
+};
+
+// streaming writer of columnar file
+//   The first column is written directly after header, and the others are
+//   spooled to temporary files, then appended on close().
+class columnar_writer {
+public:
+    columnar_writer() = default;
+    columnar_writer(const columnar_writer&) = delete;
+    columnar_writer& operator=(const columnar_writer&) = delete;
+    ~columnar_writer() { discard(); }
+
+    bool open(const char* path, std::vector<std::pair<std::string, column_type>> columns)
+    {
+        discard();
+        columns_ = std::move(columns);
+        rows_.assign(columns_.size(), 0);
+        fp_ = std::fopen(path, "wb");
+        if (!fp_) return false;
+        std::string header = make_header(0, std::vector<std::uint64_t>(columns_.size()));
+        header.resize(impl::align_up(header.size(), impl::kColumnarAlign));
+        bool ok = std::fwrite(header.data(), 1, header.size(), fp_) == header.size();
+        for (std::size_t i = 1; i < columns_.size(); ++i) {
+            spools_.push_back(std::tmpfile());
+            ok = ok && spools_.back();
+        }
+        return ok;
+    }
+
+    // append values to column, T must match its type
+    template <class T>
+    bool append(std::size_t col, const T* values, std::size_t n)
+    {
+        if (column_type_of<T>() != columns_[col].second) return false;
+        std::FILE* fp = col == 0 ? fp_ : spools_[col - 1];
+        rows_[col] += n;
+        if (impl::is_little_endian()) {
+            return std::fwrite(values, sizeof(T), n, fp) == n;
+        }
+        std::string buf;
+        for (std::size_t i = 0; i < n; ++i) {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &values[i], sizeof(T));
+            impl::store_le(buf, bits, sizeof(T));
+        }
+        return std::fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    }
+
+    // append spooled columns and write header, return false on error
+    bool close()
+    {
+        if (!fp_) return false;
+        bool ok = true;
+        for (std::size_t c = 1; c < columns_.size(); ++c) {
+            ok = ok && rows_[c] == rows_[0];
+        }
+        // track file offset by ourselves, since ftell() returns 32-bit long on some platforms
+        std::vector<std::uint64_t> offsets(columns_.size());
+        offsets[0] = impl::align_up(make_header(0, offsets).size(), impl::kColumnarAlign);
+        std::uint64_t pos = offsets[0] + (columns_.empty() ? 0 : rows_[0] * column_type_size(columns_[0].second));
+        for (std::size_t c = 1; ok && c < columns_.size(); ++c) {
+            // pad to alignment, then copy spooled column
+            std::uint64_t aligned = impl::align_up(pos, impl::kColumnarAlign);
+            static const char zeros[impl::kColumnarAlign] = {};
+            const auto pad = static_cast<std::size_t>(aligned - pos);
+            ok = std::fwrite(zeros, 1, pad, fp_) == pad;
+            offsets[c] = aligned;
+            pos = aligned;
+            std::FILE* spool = spools_[c - 1];
+            std::rewind(spool);
+            char buf[65536];
+            for (std::size_t n; ok && (n = std::fread(buf, 1, sizeof(buf), spool)) > 0; pos += n) {
+                ok = std::fwrite(buf, 1, n, fp_) == n;
+            }
+        }
+        std::string header = make_header(columns_.empty() ? 0 : rows_[0], offsets);
+        ok = ok && std::fseek(fp_, 0, SEEK_SET) == 0
+            && std::fwrite(header.data(), 1, header.size(), fp_) == header.size();
+        ok = (std::fclose(fp_) == 0) && ok;
+        fp_ = nullptr;
+        discard();
+        return ok;
+    }
+
+private:
+    std::string make_header(std::uint64_t rows, const std::vector<std::uint64_t>& offsets) const
+    {
+        std::string h{impl::kColumnarMagic, 4};
+        impl::store_le(h, impl::kColumnarVersion, 4);
+        impl::store_le(h, columns_.size(), 4);
+        impl::store_le(h, 0, 4);
+        impl::store_le(h, rows, 8);
+        for (std::size_t c = 0; c < columns_.size(); ++c) {
+            const auto& [name, type] = columns_[c];
+            impl::store_le(h, static_cast<std::uint8_t>(type), 4);
+            impl::store_le(h, name.size(), 4);
+            impl::store_le(h, offsets[c], 8);
+            h += name;
+            h.resize(impl::align_up(h.size(), 8));
+        }
+        return h;
+    }
+
+    void discard() noexcept
+    {
+        if (fp_) std::fclose(fp_);
+        fp_ = nullptr;
+        for (std::FILE* fp : spools_) {
+            if (fp) std::fclose(fp);
+        }
+        spools_.clear();
+    }
+
+    std::vector<std::pair<std::string, column_type>> columns_;
+    std::vector<std::uint64_t> rows_;
+    std::FILE* fp_ = nullptr;
+    std::vector<std::FILE*> spools_;
+};
+
+// result sink which collects values and error codes for columnar output
+//   Blank row is not an error as in text_sink, and has errc kBlankRow.
+constexpr std::int32_t kBlankRow = -1;
+
+template <class Value>
+struct columnar_sink {
+    std::vector<Value> results;
+    std::vector<std::int32_t> errcs;
+
+    void clear() noexcept
+    {
+        results.clear();
+        errcs.clear();
+    }
+    void value(Value v)
+    {
+        results.push_back(v);
+        errcs.push_back(0);
+    }
+    void error(tecalc::errc ec, const tecalc::error_location&)
+    {
+        results.push_back(Value{});
+        errcs.push_back(static_cast<std::int32_t>(ec));
+    }
+    void row_error(row_status st)
+    {
+        error(st == row_status::invalid_field ? tecalc::errc::invalid_literal : tecalc::errc::syntax_error, {});
+    }
+    void blank()
+    {
+        results.push_back(Value{});
+        errcs.push_back(kBlankRow);
+    }
+};
+
+} // namespace tools
+
+#endif
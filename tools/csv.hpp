@@ -0,0 +1,257 @@
+/*
+ * csv.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_CSV_HPP_INCLUDED_
+#define TECALC_TOOLS_CSV_HPP_INCLUDED_
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "batch.hpp"
+
+
+namespace tools {
+
+// view of numeric columns of consecutive rows
+template <class Value>
+struct column_span {
+    std::vector<const Value*> columns;          // columns[col][row]
+    const row_status* status = nullptr;         // status[row], or nullptr if all rows are ok
+    std::size_t rows = 0;
+};
+
+// numeric CSV fields of consecutive rows, stored by column
+template <class Value>
+struct column_batch {
+    std::vector<std::vector<Value>> columns;    // columns[col][row]
+    std::vector<row_status> status;             // status[row]
+
+    std::size_t rows() const noexcept { return status.size(); }
+
+    column_span<Value> span() const
+    {
+        column_span<Value> s;
+        for (const auto& col : columns) {
+            s.columns.push_back(col.data());
+        }
+        s.status = status.data();
+        s.rows = rows();
+        return s;
+    }
+};
+
+// split CSV header line into column names
+inline std::vector<std::string> parse_csv_header(std::string_view line)
+{
+    std::vector<std::string> columns;
+    for (;;) {
+        std::size_t comma = line.find(',');
+        std::string_view name = line.substr(0, comma);
+        std::size_t first = name.find_first_not_of(" \t");
+        std::size_t last = name.find_last_not_of(" \t");
+        columns.emplace_back(first == std::string_view::npos ? std::string_view{}
+                                                             : name.substr(first, last - first + 1));
+        if (comma == std::string_view::npos) break;
+        line.remove_prefix(comma + 1);
+    }
+    return columns;
+}
+
+namespace impl {
+
+// find ch in [first, last), or return last
+//   memchr is vectorized by C library.
+inline const char* find_char(const char* first, const char* last, char ch) noexcept
+{
+    const void* p = std::memchr(first, ch, static_cast<std::size_t>(last - first));
+    return p ? static_cast<const char*>(p) : last;
+}
+
+// SWAR (SIMD within a register) parsing of 8 decimal digits in little-endian word
+inline bool is_8digits(std::uint64_t w) noexcept
+{
+    return ((w & 0xF0F0F0F0F0F0F0F0u) | (((w + 0x0606060606060606u) & 0xF0F0F0F0F0F0F0F0u) >> 4))
+        == 0x3333333333333333u;
+}
+inline std::uint32_t parse_8digits(std::uint64_t w) noexcept
+{
+    w -= 0x3030303030303030u;
+    w = (w * 10 + (w >> 8)) & 0x00FF00FF00FF00FFu;
+    w = (w * 100 + (w >> 16)) & 0x0000FFFF0000FFFFu;
+    w = (w * 10000 + (w >> 32)) & 0xFFFFFFFFu;
+    return static_cast<std::uint32_t>(w);
+}
+
+// parse unsigned decimal integer of up to 19 digits, 8 digits at a time
+inline bool parse_digits_swar(const char* first, const char* last, std::uint64_t& val) noexcept
+{
+    if (first == last || 19 < last - first) return false;
+    std::uint64_t v = 0;
+    const char* p = first;
+    for (; 8 <= last - p; p += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        if (!is_8digits(w)) return false;
+        v = v * 100000000 + parse_8digits(w);
+    }
+    for (; p != last; ++p) {
+        unsigned d = static_cast<unsigned char>(*p) - '0';
+        if (9 < d) return false;
+        v = v * 10 + d;
+    }
+    val = v;
+    return true;
+}
+
+inline bool is_little_endian() noexcept
+{
+    const std::uint16_t one = 1;
+    unsigned char byte;
+    std::memcpy(&byte, &one, 1);
+    return byte == 1;
+}
+
+} // namespace impl
+
+// parse CSV field as number, return false on error
+//   Integers of 8 or more digits are parsed with SWAR, others by std::from_chars.
+template <class Value>
+bool parse_csv_field(std::string_view field, Value& val) noexcept
+{
+    const char* first = field.data();
+    const char* last = first + field.size();
+    while (first != last && (*first == ' ' || *first == '\t')) ++first;
+    while (first != last && (last[-1] == ' ' || last[-1] == '\t')) --last;
+    if constexpr (std::is_integral_v<Value>) {
+        bool neg = (first != last && *first == '-');
+        if (first != last && (*first == '+' || *first == '-')) ++first;
+        std::uint64_t u;
+        if (8 <= last - first && impl::is_little_endian() && impl::parse_digits_swar(first, last, u)) {
+            using U = std::make_unsigned_t<Value>;
+            U limit = static_cast<U>(std::numeric_limits<Value>::max()) + (neg ? 1 : 0);
+            if (u > limit || (neg && std::is_unsigned_v<Value> && u != 0)) return false;
+            val = neg ? static_cast<Value>(U{0} - static_cast<U>(u)) : static_cast<Value>(u);
+            return true;
+        }
+        if (neg) --first;
+    } else {
+        if (first != last && *first == '+') ++first;
+    }
+    auto r = std::from_chars(first, last, val);
+    return first != last && r.ec == std::errc{} && r.ptr == last;
+}
+
+// parse CSV rows of chunk into typed column buffers (reused across chunks)
+template <class Value>
+void parse_csv_chunk(std::string_view chunk, std::size_t ncols, column_batch<Value>& batch)
+{
+    batch.columns.resize(ncols);
+    for (auto& col : batch.columns) {
+        col.clear();
+    }
+    batch.status.clear();
+    const char* p = chunk.data();
+    const char* end = p + chunk.size();
+    while (p != end) {
+        const char* eol = impl::find_char(p, end, '\n');
+        const char* row_last = (eol != p && eol[-1] == '\r') ? eol - 1 : eol;
+        row_status st = row_status::ok;
+        std::size_t col = 0;
+        if (is_blank({p, static_cast<std::size_t>(row_last - p)})) {
+            st = row_status::blank;
+        } else {
+            for (const char* field = p;; ++col) {
+                const char* comma = impl::find_char(field, row_last, ',');
+                if (col < ncols) {
+                    Value v{};
+                    if (st == row_status::ok && !parse_csv_field({field, static_cast<std::size_t>(comma - field)}, v)) {
+                        st = row_status::invalid_field;
+                    }
+                    batch.columns[col].push_back(v);
+                }
+                if (comma == row_last) break;
+                field = comma + 1;
+            }
+            if (st == row_status::ok && col + 1 != ncols) {
+                st = row_status::field_count_mismatch;
+            }
+            ++col;
+        }
+        // keep all columns the same length
+        for (col = std::min(col, ncols); col < ncols; ++col) {
+            batch.columns[col].push_back(Value{});
+        }
+        batch.status.push_back(st);
+        p = (eol == end) ? end : eol + 1;
+    }
+}
+
+// evaluate expr for each row of columns, which are bound as variables named by names
+template <class Calc, class Value, class Sink>
+batch_stats eval_columns(Calc& calc, std::string_view expr, const std::vector<std::string>& names,
+                         const column_span<Value>& columns, Sink& sink)
+{
+    // bind columns once, then rebind through variable pointers for each row
+    std::vector<Value*> vars(names.size());
+    for (std::size_t col = 0; col < names.size(); ++col) {
+        if (!calc.find_var(names[col])) {
+            calc.bind_var(names[col], Value{});
+        }
+        vars[col] = calc.find_var(names[col]);
+    }
+    batch_stats stats;
+    for (std::size_t row = 0; row < columns.rows; ++row) {
+        ++stats.lines;
+        row_status st = columns.status ? columns.status[row] : row_status::ok;
+        if (st == row_status::blank) {
+            sink.blank();
+            continue;
+        } else if (st != row_status::ok) {
+            sink.row_error(st);
+            ++stats.errors;
+            continue;
+        }
+        for (std::size_t col = 0; col < vars.size(); ++col) {
+            *vars[col] = columns.columns[col][row];
+        }
+        if (auto r = calc.try_eval(expr)) {
+            sink.value(r.value);
+        } else {
+            sink.error(r.ec, calc.last_error_location());
+            ++stats.errors;
+        }
+    }
+    return stats;
+}
+
+} // namespace tools
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ * daemon.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_DAEMON_HPP_INCLUDED_
+#define TECALC_TOOLS_DAEMON_HPP_INCLUDED_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+//
+// tecalcd protocol over Unix domain stream socket (all integers are little-endian)
+//
+//   Every message is u32 payload length followed by payload.
+//
+//   PREPARE request: 'P', u16 nparams, {u16 length, name} * nparams, expression
+//     Register expression with parameter names, which are bound to arguments
+//     of EVAL requests. Same request returns same expression id. Server keeps
+//     up to kMaxExprs distinct expressions, and rejects more as bad request.
+//   EVAL request: 'E', u32 expression id, u16 nargs, 8-byte value * nargs
+//     Evaluate expression with arguments.
+//   ATTACH request: 'R', shared memory name
+//     Switch connection to shared-memory rings of tools/shm_ring.hpp. After
+//     successful response, EVAL requests are exchanged through the rings and
+//     no further requests are read from socket.
+//   response: u8 status, 8-byte payload
+//     status is 0 on success, tecalc::errc value on evaluation error, or
+//     255 on bad request. Payload is expression id (PREPARE) or value (EVAL).
+//   Value is int64 or IEEE 754 float64, as chosen by `tecalcd -t`.
+//
+namespace tools {
+namespace daemon {
+
+constexpr char kPrepare = 'P';
+constexpr char kEval = 'E';
+constexpr char kAttach = 'R';
+constexpr std::uint8_t kBadRequest = 255;
+constexpr std::uint32_t kMaxMessage = 1u << 20;
+constexpr std::uint32_t kMaxExprs = 4096;
+
+inline void put_le(std::string& buf, std::uint64_t v, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        buf += static_cast<char>((v >> (8 * i)) & 0xff);
+    }
+}
+
+inline std::uint64_t get_le(const char* p, std::size_t n) noexcept
+{
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        v |= std::uint64_t{static_cast<unsigned char>(p[i])} << (8 * i);
+    }
+    return v;
+}
+
+// 8-byte wire representation of Value
+template <class Value>
+std::uint64_t to_wire(Value v) noexcept
+{
+    static_assert(std::is_same_v<Value, long long> || std::is_same_v<Value, double>);
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, 8);
+    return bits;
+}
+template <class Value>
+Value from_wire(std::uint64_t bits) noexcept
+{
+    Value v;
+    std::memcpy(&v, &bits, 8);
+    return v;
+}
+
+inline bool write_all(int fd, const char* p, std::size_t n) noexcept
+{
+    while (n) {
+        ssize_t r = ::write(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+inline bool read_all(int fd, char* p, std::size_t n) noexcept
+{
+    while (n) {
+        ssize_t r = ::read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+// send payload with length prefix
+inline bool send_message(int fd, std::string_view payload)
+{
+    std::string buf;
+    put_le(buf, payload.size(), 4);
+    buf += payload;
+    return write_all(fd, buf.data(), buf.size());
+}
+
+// receive payload, return false on EOF, error or too large message
+inline bool recv_message(int fd, std::string& payload)
+{
+    char len[4];
+    if (!read_all(fd, len, 4)) return false;
+    std::uint32_t n = static_cast<std::uint32_t>(get_le(len, 4));
+    if (kMaxMessage < n) return false;
+    payload.resize(n);
+    return read_all(fd, payload.data(), n);
+}
+
+inline bool send_response(int fd, std::uint8_t status, std::uint64_t payload)
+{
+    std::string buf;
+    buf += static_cast<char>(status);
+    put_le(buf, payload, 8);
+    return send_message(fd, buf);
+}
+
+// blocking client of tecalcd
+template <class Value>
+class client {
+public:
+    client() = default;
+    client(const client&) = delete;
+    client& operator=(const client&) = delete;
+    ~client() { close(); }
+
+    bool connect(const char* path)
+    {
+        close();
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (sizeof(addr.sun_path) <= std::strlen(path)) return false;
+        std::strcpy(addr.sun_path, path);
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0) return false;
+        if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() noexcept
+    {
+        if (0 <= fd_) ::close(fd_);
+        fd_ = -1;
+    }
+
+    int fd() const noexcept { return fd_; }
+
+    // register expression, return false on error
+    bool prepare(std::string_view expr, const std::vector<std::string>& params, std::uint32_t& id)
+    {
+        std::string req{kPrepare};
+        put_le(req, params.size(), 2);
+        for (const auto& name : params) {
+            put_le(req, name.size(), 2);
+            req += name;
+        }
+        req += expr;
+        std::uint8_t status;
+        std::uint64_t payload;
+        if (!call(req, status, payload) || status != 0) return false;
+        id = static_cast<std::uint32_t>(payload);
+        return true;
+    }
+
+    // evaluate prepared expression, return false on communication error
+    //   status is 0 on success, tecalc::errc value, or kBadRequest.
+    bool eval(std::uint32_t id, const Value* args, std::size_t nargs, std::uint8_t& status, Value& val)
+    {
+        std::string req{kEval};
+        put_le(req, id, 4);
+        put_le(req, nargs, 2);
+        for (std::size_t i = 0; i < nargs; ++i) {
+            put_le(req, to_wire(args[i]), 8);
+        }
+        std::uint64_t payload;
+        if (!call(req, status, payload)) return false;
+        val = from_wire<Value>(payload);
+        return true;
+    }
+
+    // switch connection to shared memory segment, return false on error
+    bool attach(std::string_view shm_name)
+    {
+        std::string req{kAttach};
+        req += shm_name;
+        std::uint8_t status;
+        std::uint64_t payload;
+        return call(req, status, payload) && status == 0;
+    }
+
+private:
+    bool call(const std::string& req, std::uint8_t& status, std::uint64_t& payload)
+    {
+        if (!send_message(fd_, req) || !recv_message(fd_, buf_) || buf_.size() != 9) return false;
+        status = static_cast<std::uint8_t>(buf_[0]);
+        payload = get_le(buf_.data() + 1, 8);
+        return true;
+    }
+
+    int fd_ = -1;
+    std::string buf_;
+};
+
+} // namespace daemon
+} // namespace tools
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * mapped_file.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_MAPPED_FILE_HPP_INCLUDED_
+#define TECALC_TOOLS_MAPPED_FILE_HPP_INCLUDED_
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TECALC_TOOLS_HAS_MMAP 1
+#endif
+
+
+namespace tools {
+
+// read-only view of whole input file
+//   Regular files are memory-mapped where mmap is available; other inputs
+//   (pipe, "-" for stdin, or platforms without mmap) are read into memory.
+class mapped_file {
+public:
+    mapped_file() = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& rhs) noexcept { swap(rhs); }
+    mapped_file& operator=(mapped_file&& rhs) noexcept
+    {
+        mapped_file{std::move(rhs)}.swap(*this);
+        return *this;
+    }
+    ~mapped_file() { close(); }
+
+    // open file (or stdin if path is "-"), return false on error
+    bool open(const char* path)
+    {
+        close();
+        if (std::string_view{path} == "-") {
+            return read_all(stdin);
+        }
+#if defined(TECALC_TOOLS_HAS_MMAP)
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+                data_ = static_cast<const char*>(p);
+                size_ = static_cast<size_t>(st.st_size);
+                mapped_ = true;
+                ::close(fd);
+                return true;
+            }
+        }
+        ::close(fd);
+#endif
+        std::FILE* fp = std::fopen(path, "rb");
+        if (!fp) return false;
+        bool ok = read_all(fp);
+        std::fclose(fp);
+        return ok;
+    }
+
+    void close() noexcept
+    {
+#if defined(TECALC_TOOLS_HAS_MMAP)
+        if (mapped_) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        mapped_ = false;
+        buf_.clear();
+    }
+
+    std::string_view view() const noexcept { return {data_, size_}; }
+    bool mapped() const noexcept { return mapped_; }
+
+    void swap(mapped_file& rhs) noexcept
+    {
+        std::swap(data_, rhs.data_);
+        std::swap(size_, rhs.size_);
+        std::swap(mapped_, rhs.mapped_);
+        buf_.swap(rhs.buf_);
+        // buf_ storage may be SSO, so re-point data_ at it
+        if (!mapped_) data_ = buf_.data();
+        if (!rhs.mapped_) rhs.data_ = rhs.buf_.data();
+    }
+
+private:
+    bool read_all(std::FILE* fp)
+    {
+        char chunk[65536];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+            buf_.append(chunk, n);
+        }
+        data_ = buf_.data();
+        size_ = buf_.size();
+        return !std::ferror(fp);
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buf_;
+};
+
+} // namespace tools
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * pipeline.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_PIPELINE_HPP_INCLUDED_
+#define TECALC_TOOLS_PIPELINE_HPP_INCLUDED_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace tools {
+
+// blocking FIFO queue with capacity for backpressure
+template <class T>
+class bounded_queue {
+public:
+    explicit bounded_queue(std::size_t capacity) : capacity_{capacity} {}
+
+    // block while queue is full
+    void push(T v)
+    {
+        std::unique_lock<std::mutex> lk{mtx_};
+        not_full_.wait(lk, [&]{ return items_.size() < capacity_; });
+        items_.push_back(std::move(v));
+        not_empty_.notify_one();
+    }
+
+    // block while queue is empty, return false if queue is closed and drained
+    bool pop(T& v)
+    {
+        std::unique_lock<std::mutex> lk{mtx_};
+        not_empty_.wait(lk, [&]{ return !items_.empty() || closed_; });
+        if (items_.empty()) return false;
+        v = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // wake up all consumers after remaining items
+    void close()
+    {
+        std::lock_guard<std::mutex> lk{mtx_};
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    std::size_t capacity_;
+    bool closed_ = false;
+};
+
+// read -> evaluate -> write pipeline over a fixed set of slots
+//   read(Slot&) fills next chunk into slot on the calling thread, and returns
+//   false at end of input. eval(worker, Slot&) runs on `workers` threads.
+//   write(Slot&) runs on writer thread in read order. A slot is reused after
+//   it has been written, so at most slots.size() chunks are in flight.
+template <class Slot, class Read, class Eval, class Write>
+void run_pipeline(std::vector<Slot>& slots, unsigned workers, Read read, Eval eval, Write write)
+{
+    struct ticket {
+        std::size_t seq;
+        std::size_t slot;
+    };
+    const std::size_t n = slots.size();
+    bounded_queue<std::size_t> free_q{n};
+    bounded_queue<ticket> eval_q{n};
+    bounded_queue<ticket> write_q{n};
+    for (std::size_t i = 0; i < n; ++i) {
+        free_q.push(i);
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < workers; ++w) {
+        threads.emplace_back([&, w]{
+            for (ticket t; eval_q.pop(t); ) {
+                eval(w, slots[t.slot]);
+                write_q.push(t);
+            }
+        });
+    }
+    std::thread writer{[&]{
+        // reorder finished slots by sequence number
+        std::map<std::size_t, std::size_t> done;
+        std::size_t next = 0;
+        for (ticket t; write_q.pop(t); ) {
+            done.emplace(t.seq, t.slot);
+            for (auto it = done.begin(); it != done.end() && it->first == next; it = done.erase(it)) {
+                write(slots[it->second]);
+                free_q.push(it->second);
+                ++next;
+            }
+        }
+    }};
+
+    std::size_t seq = 0;
+    for (std::size_t i; free_q.pop(i); ++seq) {
+        if (!read(slots[i])) break;
+        eval_q.push({seq, i});
+    }
+    eval_q.close();
+    for (auto& th : threads) {
+        th.join();
+    }
+    write_q.close();
+    writer.join();
+}
+
+} // namespace tools
+
+#endif
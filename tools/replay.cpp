@@ -0,0 +1,111 @@
+/*
+ * replay.cpp -- replay captured tecalc workload
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "tecalc.hpp"
+#include "tecalc_replay.hpp"
+
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: tecalc_replay [-r REPEAT] WORKLOAD\n"
+        "Replay workload captured by tecalc::workload_recorder<int>, and report\n"
+        "throughput and results which differ from recorded ones.\n"
+        "Workload which binds user-defined functions cannot be replayed.\n");
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    int repeat = 1;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-r" && i + 1 < argc) {
+            repeat = std::atoi(argv[++i]);
+        } else if (arg[0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!path || repeat < 1) {
+        usage();
+        return 2;
+    }
+
+    std::ifstream ifs{path, std::ios::binary};
+    std::vector<tecalc::workload_record<int>> records;
+    if (!ifs || !tecalc::read_workload(ifs, records)) {
+        std::fprintf(stderr, "%s: broken workload file (or not recorded with int value)\n", path);
+        return 1;
+    }
+
+    // this tool has no user-defined functions to bind
+    std::string functions;
+    for (const auto& r : records) {
+        if (r.tag == tecalc::workload_tag::bind_fn) {
+            functions += (functions.empty() ? "'" : ", '") + r.text + "'";
+        }
+    }
+    if (!functions.empty()) {
+        std::fprintf(stderr, "%s: cannot replay workload which binds function %s\n", path, functions.c_str());
+        return 1;
+    }
+
+    tecalc::replay_report<int> best;
+    for (int i = 0; i < repeat; ++i) {
+        tecalc::calculator calc;
+        auto report = tecalc::replay(records, calc);
+        if (i == 0 || report.seconds < best.seconds) {
+            best = std::move(report);
+        }
+    }
+
+    std::printf("evaluations: %llu\n", static_cast<unsigned long long>(best.evaluations));
+    std::printf("bindings:    %llu\n", static_cast<unsigned long long>(best.bindings));
+    std::printf("time:        %.6f s (best of %d)\n", best.seconds, repeat);
+    std::printf("throughput:  %.0f eval/s\n", best.throughput());
+    std::printf("mismatches:  %llu\n", static_cast<unsigned long long>(best.mismatches));
+    for (const auto& m : best.first_mismatches) {
+        std::printf("  %s: recorded %d (errc=%d), replayed %d (errc=%d)\n", m.expr.c_str(),
+                    m.expected, static_cast<int>(m.expected_ec), m.actual, static_cast<int>(m.actual_ec));
+    }
+    if (best.unbound) {
+        std::printf("note: %llu evaluations failed with unknown identifier; record bindings made before\n"
+                    "      start() by start(os, calc.variables(), calc.functions())\n",
+                    static_cast<unsigned long long>(best.unbound));
+    }
+    return best.mismatches ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * shm_ring.hpp
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TECALC_TOOLS_SHM_RING_HPP_INCLUDED_
+#define TECALC_TOOLS_SHM_RING_HPP_INCLUDED_
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "daemon.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+
+//
+// Shared-memory transport of tecalcd
+//
+//   A client creates shared memory segment (shm_open) with request and response
+//   rings, and sends its name by ATTACH request ('R', name) of tools/daemon.hpp.
+//   Then the connection thread of tecalcd polls request ring, evaluates each
+//   request, and pushes response, until the client closes the segment.
+//   Waiting side spins for a while, then either keeps polling (busy_poll) or
+//   sleeps on futex (futex, Linux only; other platforms yield instead).
+//
+namespace tools {
+namespace shm {
+
+enum class wait_mode : std::uint32_t {
+    busy_poll = 0,
+    futex = 1,
+};
+
+constexpr std::uint32_t kMagic = 0x52534354;    // "TCSR"
+constexpr std::uint32_t kMaxArgs = 15;
+constexpr std::uint32_t kRingSize = 64;
+constexpr unsigned kSpinCount = 2000;
+
+struct request_slot {
+    std::uint32_t id;
+    std::uint32_t nargs;
+    std::uint64_t args[kMaxArgs];   // wire representation (tools::daemon::to_wire)
+};
+
+struct response_slot {
+    std::uint64_t status;
+    std::uint64_t value;
+};
+
+namespace impl {
+
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// sleep while *addr == val (with timeout to re-check stop condition)
+inline void futex_wait(std::atomic<std::uint32_t>* addr, std::uint32_t val) noexcept
+{
+#if defined(__linux__)
+    timespec timeout{0, 50 * 1000 * 1000};
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(addr), FUTEX_WAIT, val, &timeout, nullptr, 0);
+#else
+    (void)addr;
+    (void)val;
+    std::this_thread::yield();
+#endif
+}
+
+inline void futex_wake(std::atomic<std::uint32_t>* addr) noexcept
+{
+#if defined(__linux__)
+    ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(addr), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)addr;
+#endif
+}
+
+// attached connection carries no more data on socket, so anything other
+// than EAGAIN (EOF, unexpected data, or error) means that peer has gone
+inline bool socket_closed(int fd) noexcept
+{
+    char c;
+    ssize_t r = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return !(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+// spinning only helps when peer runs on another CPU
+inline unsigned spin_limit() noexcept
+{
+    static const unsigned n = 1 < std::thread::hardware_concurrency() ? kSpinCount : 0;
+    return n;
+}
+
+// wait until ready() with wait mode, return false if stop() becomes true
+template <class Ready, class Stop>
+bool wait_for(std::atomic<std::uint32_t>& word, std::atomic<std::uint32_t>& waiters,
+              wait_mode mode, Ready ready, Stop stop)
+{
+    for (unsigned spin = 0;; ++spin) {
+        if (ready()) return true;
+        if (spin < spin_limit()) {
+            cpu_relax();
+            continue;
+        }
+        if (spin % 256 == 0 && stop()) return false;
+        if (mode == wait_mode::busy_poll) {
+            // keep polling, but give up CPU to other threads occasionally
+            if (spin_limit() == 0 || spin % 64 == 0) std::this_thread::yield();
+            else cpu_relax();
+            continue;
+        }
+        // Publish waiter before re-checking word, so that producer's
+        // store and waiters load cannot miss each other (Dekker).
+        std::uint32_t observed = word.load(std::memory_order_seq_cst);
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool done = ready();
+        if (!done) {
+            futex_wait(&word, observed);
+        }
+        waiters.fetch_sub(1, std::memory_order_seq_cst);
+        if (done) return true;
+        if (stop()) return ready();
+    }
+}
+
+} // namespace impl
+
+// single-producer single-consumer ring placed in shared memory
+template <class T, std::uint32_t N>
+struct spsc_ring {
+    static_assert((N & (N - 1)) == 0, "ring size must be power of 2");
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+
+    alignas(64) std::atomic<std::uint32_t> head;        // next position to pop
+    std::atomic<std::uint32_t> head_waiters;            // producers waiting for space
+    alignas(64) std::atomic<std::uint32_t> tail;        // next position to push
+    std::atomic<std::uint32_t> tail_waiters;            // consumers waiting for item
+    alignas(64) T slots[N];
+
+    void init() noexcept
+    {
+        head.store(0);
+        head_waiters.store(0);
+        tail.store(0);
+        tail_waiters.store(0);
+    }
+
+    bool try_push(const T& v) noexcept
+    {
+        std::uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        slots[t % N] = v;
+        tail.store(t + 1, std::memory_order_seq_cst);
+        if (tail_waiters.load(std::memory_order_seq_cst)) impl::futex_wake(&tail);
+        return true;
+    }
+
+    bool try_pop(T& v) noexcept
+    {
+        std::uint32_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) == h) return false;
+        v = slots[h % N];
+        head.store(h + 1, std::memory_order_seq_cst);
+        if (head_waiters.load(std::memory_order_seq_cst)) impl::futex_wake(&head);
+        return true;
+    }
+
+    // blocking push/pop, return false if stop() becomes true while waiting
+    template <class Stop>
+    bool push(const T& v, wait_mode mode, Stop stop)
+    {
+        return impl::wait_for(head, head_waiters, mode, [&]{ return try_push(v); }, stop);
+    }
+    template <class Stop>
+    bool pop(T& v, wait_mode mode, Stop stop)
+    {
+        return impl::wait_for(tail, tail_waiters, mode, [&]{ return try_pop(v); }, stop);
+    }
+};
+
+// shared memory segment layout
+struct segment {
+    std::uint32_t magic;
+    wait_mode mode;
+    std::atomic<std::uint32_t> closed;
+    spsc_ring<request_slot, kRingSize> requests;
+    spsc_ring<response_slot, kRingSize> responses;
+
+    bool is_closed() const noexcept { return closed.load(std::memory_order_acquire) != 0; }
+
+    // mark closed and wake up both sides
+    void close() noexcept
+    {
+        closed.store(1, std::memory_order_seq_cst);
+        impl::futex_wake(&requests.tail);
+        impl::futex_wake(&requests.head);
+        impl::futex_wake(&responses.tail);
+        impl::futex_wake(&responses.head);
+    }
+};
+
+// user id of peer process connected to Unix domain socket fd
+inline bool peer_uid(int fd, uid_t& uid) noexcept
+{
+#if defined(SO_PEERCRED)
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return false;
+    uid = cred.uid;
+    return true;
+#else
+    gid_t gid;
+    return ::getpeereid(fd, &uid, &gid) == 0;
+#endif
+}
+
+// mapping of shared memory segment
+class mapped_segment {
+public:
+    mapped_segment() = default;
+    mapped_segment(const mapped_segment&) = delete;
+    mapped_segment& operator=(const mapped_segment&) = delete;
+    ~mapped_segment() { unmap(); }
+
+    // create and initialize segment with unique name
+    bool create(wait_mode mode)
+    {
+        static std::atomic<unsigned> counter{0};
+        name_ = "/tecalc-" + std::to_string(::getpid()) + "-" + std::to_string(counter++);
+        int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) return false;
+        bool ok = ::ftruncate(fd, sizeof(segment)) == 0 && map(fd);
+        ::close(fd);
+        if (!ok) {
+            unlink();
+            return false;
+        }
+        seg_ = new (seg_) segment;
+        seg_->magic = kMagic;
+        seg_->mode = mode;
+        seg_->closed.store(0);
+        seg_->requests.init();
+        seg_->responses.init();
+        return true;
+    }
+
+    // open segment created by peer whose user id is owner
+    //   Segment must be large enough, since accessing mapping beyond the end
+    //   of shared memory object raises SIGBUS.
+    bool open(const std::string& name, uid_t owner)
+    {
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0 && st.st_uid == owner
+            && static_cast<std::uintmax_t>(sizeof(segment)) <= static_cast<std::uintmax_t>(st.st_size)
+            && map(fd);
+        ::close(fd);
+        if (ok && seg_->magic != kMagic) {
+            unmap();
+            return false;
+        }
+        name_ = name;
+        return ok;
+    }
+
+    // remove name of segment (mappings stay valid)
+    void unlink() noexcept
+    {
+        if (!name_.empty()) ::shm_unlink(name_.c_str());
+        name_.clear();
+    }
+
+    void unmap() noexcept
+    {
+        if (seg_) ::munmap(seg_, sizeof(segment));
+        seg_ = nullptr;
+    }
+
+    segment* get() const noexcept { return seg_; }
+    const std::string& name() const noexcept { return name_; }
+
+private:
+    bool map(int fd) noexcept
+    {
+        void* p = ::mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        seg_ = static_cast<segment*>(p);
+        return true;
+    }
+
+    segment* seg_ = nullptr;
+    std::string name_;
+};
+
+// blocking client of tecalcd through shared memory
+//   PREPARE requests go through socket, then connection is attached to
+//   segment on first eval(), and EVAL requests go through rings.
+template <class Value>
+class ring_client {
+public:
+    explicit ring_client(wait_mode mode = wait_mode::futex) noexcept : mode_{mode} {}
+    ~ring_client() { close(); }
+
+    bool connect(const char* path)
+    {
+        close();
+        return cli_.connect(path);
+    }
+
+    void close() noexcept
+    {
+        if (seg_.get()) seg_.get()->close();
+        seg_.unmap();
+        cli_.close();
+    }
+
+    // register expression, must be called before first eval()
+    bool prepare(std::string_view expr, const std::vector<std::string>& params, std::uint32_t& id)
+    {
+        return !seg_.get() && cli_.prepare(expr, params, id);
+    }
+
+    // evaluate prepared expression, return false on communication error
+    //   status is 0 on success, tecalc::errc value, or tools::daemon::kBadRequest.
+    bool eval(std::uint32_t id, const Value* args, std::size_t nargs, std::uint8_t& status, Value& val)
+    {
+        if (kMaxArgs < nargs || (!seg_.get() && !attach())) return false;
+        segment* seg = seg_.get();
+        request_slot req;
+        req.id = id;
+        req.nargs = static_cast<std::uint32_t>(nargs);
+        for (std::size_t i = 0; i < nargs; ++i) {
+            req.args[i] = daemon::to_wire(args[i]);
+        }
+        response_slot res;
+        // server closes segment or socket when it stops
+        auto stop = [&]{ return seg->is_closed() || impl::socket_closed(cli_.fd()); };
+        if (!seg->requests.push(req, mode_, stop) || !seg->responses.pop(res, mode_, stop)) return false;
+        status = static_cast<std::uint8_t>(res.status);
+        val = daemon::from_wire<Value>(res.value);
+        return true;
+    }
+
+private:
+    bool attach()
+    {
+        if (!seg_.create(mode_)) return false;
+        bool ok = cli_.attach(seg_.name());
+        seg_.unlink();  // opened by server, or failed
+        if (!ok) seg_.unmap();
+        return ok;
+    }
+
+    wait_mode mode_;
+    daemon::client<Value> cli_;
+    mapped_segment seg_;
+};
+
+} // namespace shm
+} // namespace tools
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * replay.cpp -- replay captured tecalc workload
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "tecalc.hpp"
+#include "tecalc_stream.hpp"
+#include "batch.hpp"
+#include "columnar.hpp"
+#include "csv.hpp"
+#include "mapped_file.hpp"
+#include "pipeline.hpp"
+
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: tecalc [-j THREADS] [-c CHUNK_BYTES] [-q SLOTS] [-t int|long|double]\n"
+        "              [-D NAME=VALUE]... [-e EXPR] [-o OUTPUT] [FILE...]\n"
+        "       tecalc [-t int|long|double] -C OUTPUT CSVFILE\n"
+        "       tecalc [-c CHUNK_BYTES] [-t int|long|double] [-D NAME=VALUE]... -s [FILE...]\n"
+        "Evaluate each line of FILEs (or stdin) as an expression, and print results\n"
+        "line by line. With -e, FILEs are CSV with header line (or columnar files),\n"
+        "and EXPR is evaluated for each row whose fields are bound to variables\n"
+        "named by the header.\n"
+        "Failed evaluations print 'error: ...' line, and exit status becomes 1.\n"
+        "Input is read by CHUNK_BYTES, evaluated by THREADS, and written in order;\n"
+        "at most SLOTS chunks (default 2*THREADS+2) are in flight.\n"
+        "-o writes 'result' and 'errc' columns into columnar OUTPUT file instead.\n"
+        "-C converts CSVFILE into columnar OUTPUT file.\n"
+        "-s evaluates whole FILE as one expression (line breaks are spaces), which is\n"
+        "read by CHUNK_BYTES and evaluated while reading.\n");
+}
+
+struct options {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t chunk_size = std::size_t{4} << 20;
+    std::size_t slots = 0;      // 0 means 2 * threads + 2
+    std::string type = "long";
+    std::vector<std::pair<std::string, std::string>> defines;
+    const char* expr = nullptr;
+    const char* output = nullptr;
+    const char* convert = nullptr;
+    bool stream = false;
+    std::vector<const char*> files;
+};
+
+// pipeline slot, which holds one chunk from read to write
+template <class Value, class Sink>
+struct chunk_slot {
+    std::string_view chunk;             // text input
+    tools::column_batch<Value> batch;   // parsed or converted columns
+    tools::column_span<Value> span;     // columns to evaluate
+    Sink sink;
+    tools::batch_stats stats;
+};
+
+// evaluate input with read (parse) / evaluate / write stages
+//   Input is lines of expression, CSV or columnar file (with opt.expr).
+template <class Calc, class Sink, class Write>
+tools::batch_stats process(const Calc& proto, const options& opt, std::string_view input, Write write)
+{
+    using value_type = typename Calc::value_type;
+    using slot_type = chunk_slot<value_type, Sink>;
+    std::vector<std::string> names;
+    tools::columnar_reader columnar;
+    std::size_t next_row = 0, chunk_rows = 0;
+    if (opt.expr && columnar.open(input)) {
+        for (const auto& col : columnar.columns()) {
+            names.push_back(col.name);
+        }
+        chunk_rows = std::max<std::size_t>(1, opt.chunk_size / (8 * std::max<std::size_t>(1, names.size())));
+    } else if (opt.expr) {
+        names = tools::parse_csv_header(tools::next_line(input));
+    }
+    const bool is_columnar = chunk_rows != 0;
+    std::vector<Calc> calcs(opt.threads, proto);
+    std::vector<slot_type> slots(opt.slots ? opt.slots : 2 * opt.threads + 2);
+    tools::batch_stats total;
+
+    tools::run_pipeline(slots, opt.threads,
+        [&](slot_type& s) {
+            if (is_columnar) {
+                // use column blocks directly if possible, or convert them
+                if (next_row == columnar.rows()) return false;
+                const std::size_t n = std::min(chunk_rows, columnar.rows() - next_row);
+                s.batch.columns.resize(names.size());
+                s.span.columns.resize(names.size());
+                s.span.status = nullptr;
+                for (std::size_t col = 0; col < names.size(); ++col) {
+                    s.span.columns[col] = columnar.direct<value_type>(col, next_row);
+                    if (!s.span.columns[col]) {
+                        if (!s.span.status) {
+                            s.batch.status.assign(n, tools::row_status::ok);
+                            s.span.status = s.batch.status.data();
+                        }
+                        columnar.load(col, next_row, n, s.batch.columns[col], s.batch.status);
+                        s.span.columns[col] = s.batch.columns[col].data();
+                    }
+                }
+                s.span.rows = n;
+                next_row += n;
+                return true;
+            }
+            if (input.empty()) return false;
+            s.chunk = tools::next_chunk(input, opt.chunk_size);
+            if (opt.expr) {
+                tools::parse_csv_chunk(s.chunk, names.size(), s.batch);
+                s.span = s.batch.span();
+            } else {
+                tools::touch_pages(s.chunk);
+            }
+            return true;
+        },
+        [&](unsigned w, slot_type& s) {
+            s.sink.clear();
+            s.stats = opt.expr ? tools::eval_columns(calcs[w], opt.expr, names, s.span, s.sink)
+                               : tools::eval_lines(calcs[w], s.chunk, s.sink);
+        },
+        [&](slot_type& s) {
+            write(s.sink);
+            total += s.stats;
+        });
+    return total;
+}
+
+// convert CSV file into columnar file
+template <class Value>
+tools::batch_stats convert(const options& opt, std::string_view input)
+{
+    tools::columnar_writer writer;
+    std::vector<std::string> names = tools::parse_csv_header(tools::next_line(input));
+    std::vector<std::pair<std::string, tools::column_type>> columns;
+    for (const auto& name : names) {
+        columns.emplace_back(name, tools::column_type_of<Value>());
+    }
+    tools::batch_stats stats;
+    if (!writer.open(opt.convert, std::move(columns))) {
+        stats.errors = 1;
+        return stats;
+    }
+    tools::column_batch<Value> batch;
+    while (!input.empty()) {
+        tools::parse_csv_chunk(tools::next_chunk(input, opt.chunk_size), names.size(), batch);
+        for (std::size_t col = 0; col < names.size(); ++col) {
+            writer.append(col, batch.columns[col].data(), batch.rows());
+        }
+        stats.lines += batch.rows();
+        for (tools::row_status st : batch.status) {
+            if (st != tools::row_status::ok) ++stats.errors;
+        }
+    }
+    if (!writer.close()) {
+        std::fprintf(stderr, "tecalc: cannot write %s\n", opt.convert);
+        ++stats.errors;
+    }
+    return stats;
+}
+
+// evaluate whole file as one expression, which is read and fed by chunks
+template <class Calc>
+tools::batch_stats stream_file(Calc& calc, const options& opt, const char* path)
+{
+    tools::batch_stats stats;
+    tools::text_sink<typename Calc::value_type> sink;
+    std::FILE* fp = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "rb");
+    if (!fp) {
+        std::fprintf(stderr, "tecalc: cannot read %s\n", path);
+        stats.errors = 1;
+        return stats;
+    }
+    std::unique_ptr<char[]> buf{new char[opt.chunk_size]};
+    tecalc::stream_evaluator<Calc> s{calc};
+    std::size_t n;
+    while ((n = std::fread(buf.get(), 1, opt.chunk_size, fp)) != 0) {
+        std::replace(buf.get(), buf.get() + n, '\n', ' ');
+        std::replace(buf.get(), buf.get() + n, '\r', ' ');
+        // stop reading at the first error
+        if (!s.feed({buf.get(), n})) break;
+    }
+    if (fp != stdin) std::fclose(fp);
+    if (auto r = s.try_finish()) {
+        sink.value(r.value);
+    } else {
+        sink.error(r.ec, calc.last_error_location());
+        ++stats.errors;
+    }
+    ++stats.lines;
+    std::fwrite(sink.out.data(), 1, sink.out.size(), stdout);
+    return stats;
+}
+
+template <class Value>
+int run(const options& opt)
+{
+    tecalc::basic_calculator<Value> proto;
+    for (const auto& [name, text] : opt.defines) {
+        Value val;
+        if (!tools::parse_csv_field(text, val)) {
+            std::fprintf(stderr, "tecalc: invalid value '%s' for %s\n", text.c_str(), name.c_str());
+            return 2;
+        }
+        proto.bind_var(name, val);
+    }
+
+    tools::columnar_writer writer;
+    if (opt.output && !writer.open(opt.output, {{"result", tools::column_type_of<Value>()},
+                                                {"errc", tools::column_type::int32}})) {
+        std::fprintf(stderr, "tecalc: cannot write %s\n", opt.output);
+        return 2;
+    }
+    tools::batch_stats total;
+    for (const char* path : opt.files) {
+        if (opt.stream) {
+            total += stream_file(proto, opt, path);
+            continue;
+        }
+        tools::mapped_file file;
+        if (!file.open(path)) {
+            std::fprintf(stderr, "tecalc: cannot read %s\n", path);
+            return 2;
+        }
+        if (opt.convert) {
+            total += convert<Value>(opt, file.view());
+        } else if (opt.output) {
+            total += process<decltype(proto), tools::columnar_sink<Value>>(proto, opt, file.view(),
+                [&](const tools::columnar_sink<Value>& sink) {
+                    writer.append(0, sink.results.data(), sink.results.size());
+                    writer.append(1, sink.errcs.data(), sink.errcs.size());
+                });
+        } else {
+            total += process<decltype(proto), tools::text_sink<Value>>(proto, opt, file.view(),
+                [](const tools::text_sink<Value>& sink) {
+                    std::fwrite(sink.out.data(), 1, sink.out.size(), stdout);
+                });
+        }
+    }
+    std::fflush(stdout);
+    if (opt.output && !writer.close()) {
+        std::fprintf(stderr, "tecalc: cannot write %s\n", opt.output);
+        return 2;
+    }
+    if (total.errors) {
+        std::fprintf(stderr, "tecalc: %zu errors in %zu lines\n", total.errors, total.lines);
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    options opt;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            opt.threads = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "-c" && i + 1 < argc) {
+            opt.chunk_size = static_cast<std::size_t>(std::atoll(argv[++i]));
+        } else if (arg == "-q" && i + 1 < argc) {
+            opt.slots = static_cast<std::size_t>(std::atoll(argv[++i]));
+        } else if (arg == "-t" && i + 1 < argc) {
+            opt.type = argv[++i];
+        } else if (arg == "-D" && i + 1 < argc) {
+            std::string def = argv[++i];
+            std::size_t eq = def.find('=');
+            if (eq == std::string::npos) {
+                usage();
+                return 2;
+            }
+            opt.defines.emplace_back(def.substr(0, eq), def.substr(eq + 1));
+        } else if (arg == "-e" && i + 1 < argc) {
+            opt.expr = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            opt.output = argv[++i];
+        } else if (arg == "-C" && i + 1 < argc) {
+            opt.convert = argv[++i];
+        } else if (arg == "-s") {
+            opt.stream = true;
+        } else if (arg == "-" || arg[0] != '-') {
+            opt.files.push_back(argv[i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.threads < 1 || opt.chunk_size < 1 || (opt.convert && (opt.files.size() != 1 || opt.expr || opt.output))
+        || (opt.stream && (opt.convert || opt.expr || opt.output))) {
+        usage();
+        return 2;
+    }
+    if (opt.files.empty()) {
+        opt.files.push_back("-");
+    }
+
+    if (opt.type == "int") {
+        return run<int>(opt);
+    } else if (opt.type == "long") {
+        return run<long long>(opt);
+    } else if (opt.type == "double") {
+        return run<double>(opt);
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,180 @@
+/*
+ * replay.cpp -- replay captured tecalc workload
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tecalc.hpp"
+#include "tecalc_metrics.hpp"
+#include "csv.hpp"
+#include "daemon.hpp"
+#include "shm_ring.hpp"
+
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: tecalcc [-t long|double] [-n REQUESTS] [-c CONNECTIONS] [-s busy|futex] SOCKET EXPR [NAME=VALUE]...\n"
+        "Evaluate EXPR with parameters NAMEs bound to VALUEs on tecalcd, and print the result.\n"
+        "With -n/-c, each of CONNECTIONS sends REQUESTS requests, and latency is reported.\n"
+        "With -s, EVAL requests go through shared memory with busy-poll or futex wait.\n");
+}
+
+// send requests on one connection, return false on communication error
+template <class Value, class Client>
+bool send_requests(Client& cli, const char* path, const char* expr, const std::vector<std::string>& params,
+                   const std::vector<Value>& args, int requests, tecalc::latency_histogram& latency,
+                   std::uint8_t& status, Value& result)
+{
+    std::uint32_t id;
+    if (!cli.connect(path) || !cli.prepare(expr, params, id)) return false;
+    for (int i = 0; i < requests; ++i) {
+        auto s = std::chrono::steady_clock::now();
+        if (!cli.eval(id, args.data(), args.size(), status, result)) return false;
+        auto e = std::chrono::steady_clock::now();
+        latency.record(static_cast<std::uint64_t>(std::chrono::nanoseconds{e - s}.count()));
+    }
+    return true;
+}
+
+template <class Value>
+int run(const char* path, const char* expr, const std::vector<std::string>& defs, int requests, int conns,
+        const std::string& shm)
+{
+    std::vector<std::string> params;
+    std::vector<Value> args;
+    for (const auto& def : defs) {
+        std::size_t eq = def.find('=');
+        Value val;
+        if (eq == std::string::npos || !tools::parse_csv_field(std::string_view{def}.substr(eq + 1), val)) {
+            std::fprintf(stderr, "tecalcc: invalid parameter '%s'\n", def.c_str());
+            return 2;
+        }
+        params.push_back(def.substr(0, eq));
+        args.push_back(val);
+    }
+
+    std::vector<tecalc::latency_histogram> latency(conns);
+    std::vector<int> failed(conns);
+    std::uint8_t status = 0;
+    Value result{};
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < conns; ++c) {
+        threads.emplace_back([&, c]{
+            std::uint8_t st = 0;
+            Value val{};
+            bool ok;
+            if (shm.empty()) {
+                tools::daemon::client<Value> cli;
+                ok = send_requests(cli, path, expr, params, args, requests, latency[c], st, val);
+            } else {
+                tools::shm::ring_client<Value> cli{shm == "busy" ? tools::shm::wait_mode::busy_poll
+                                                                 : tools::shm::wait_mode::futex};
+                ok = send_requests(cli, path, expr, params, args, requests, latency[c], st, val);
+            }
+            failed[c] = !ok;
+            if (c == 0) {
+                status = st;
+                result = val;
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    for (int c = 0; c < conns; ++c) {
+        if (failed[c]) {
+            std::fprintf(stderr, "tecalcc: cannot communicate with %s\n", path);
+            return 2;
+        }
+        if (c) latency[0].merge(latency[c]);
+    }
+
+    if (status == 0) {
+        std::string out;
+        tools::append_value(out, result);
+        std::printf("%s\n", out.c_str());
+    } else if (status == tools::daemon::kBadRequest) {
+        std::printf("error: Bad request\n");
+    } else {
+        std::printf("error: %s\n", tecalc::tecalc_category().message(status).c_str());
+    }
+    if (1 < requests || 1 < conns) {
+        const auto& h = latency[0];
+        std::fprintf(stderr, "%llu requests in %.3f s (%.0f req/s), latency p50 %llu ns, p99 %llu ns, max %llu ns\n",
+                     static_cast<unsigned long long>(h.count()), sec, h.count() / sec,
+                     static_cast<unsigned long long>(h.percentile(0.5)),
+                     static_cast<unsigned long long>(h.percentile(0.99)),
+                     static_cast<unsigned long long>(h.max()));
+    }
+    return status == 0 ? 0 : 1;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    std::string type = "long";
+    int requests = 1, conns = 1;
+    std::string shm;
+    std::vector<const char*> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) {
+            type = argv[++i];
+        } else if (arg == "-n" && i + 1 < argc) {
+            requests = std::atoi(argv[++i]);
+        } else if (arg == "-c" && i + 1 < argc) {
+            conns = std::atoi(argv[++i]);
+        } else if (arg == "-s" && i + 1 < argc) {
+            shm = argv[++i];
+        } else if (arg[0] != '-' || positional.size() >= 2) {
+            positional.push_back(argv[i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (positional.size() < 2 || requests < 1 || conns < 1 || !(shm.empty() || shm == "busy" || shm == "futex")) {
+        usage();
+        return 2;
+    }
+    std::vector<std::string> defs(positional.begin() + 2, positional.end());
+    if (type == "long") {
+        return run<long long>(positional[0], positional[1], defs, requests, conns, shm);
+    } else if (type == "double") {
+        return run<double>(positional[0], positional[1], defs, requests, conns, shm);
+    }
+    usage();
+    return 2;
+}
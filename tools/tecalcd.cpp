@@ -0,0 +1,460 @@
+/*
+ * replay.cpp -- replay captured tecalc workload
+ *
+ * MIT License
+ *
+ * Copyright 2021 yohhoy
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "tecalc.hpp"
+#include "batch.hpp"
+#include "columnar.hpp"
+#include "csv.hpp"
+#include "daemon.hpp"
+#include "mapped_file.hpp"
+#include "shm_ring.hpp"
+
+#include <signal.h>
+
+
+namespace {
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: tecalcd [-t long|double] [-D NAME=VALUE]... [-b BINDINGS] SOCKET\n"
+        "Serve PREPARE/EVAL requests (see tools/daemon.hpp) on Unix domain SOCKET.\n"
+        "Variables are preloaded from -D options and BINDINGS file of NAME=VALUE lines.\n"
+        "Concurrent EVAL requests for the same expression are evaluated as a batch.\n"
+        "Attached clients (see tools/shm_ring.hpp) are served through shared memory.\n");
+}
+
+volatile std::sig_atomic_t g_stop = 0;
+
+extern "C" void on_signal(int)
+{
+    g_stop = 1;
+}
+
+template <class Value>
+class server {
+public:
+    explicit server(tecalc::basic_calculator<Value> proto) : proto_{std::move(proto)} {}
+
+    // register expression, and store its id; return false when table is full
+    bool prepare(std::vector<std::string> params, std::string expr, std::uint32_t& id)
+    {
+        std::string key;
+        for (const auto& name : params) {
+            key += name;
+            key += ',';
+        }
+        key += '\n';
+        key += expr;
+        std::lock_guard<std::mutex> lk{exprs_mtx_};
+        auto it = ids_.find(key);
+        if (it == ids_.end()) {
+            // each expression owns calculator with preloaded bindings
+            if (tools::daemon::kMaxExprs <= exprs_.size()) return false;
+            it = ids_.emplace(std::move(key), static_cast<std::uint32_t>(exprs_.size())).first;
+            exprs_.push_back({std::move(expr), std::move(params), proto_});
+        }
+        id = it->second;
+        return true;
+    }
+
+    // evaluate expression with args, blocks until its batch is evaluated
+    std::pair<std::uint8_t, Value> eval(std::uint32_t id, std::vector<Value> args)
+    {
+        {
+            std::lock_guard<std::mutex> lk{exprs_mtx_};
+            if (exprs_.size() <= id || exprs_[id].params.size() != args.size()) {
+                return {tools::daemon::kBadRequest, Value{}};
+            }
+        }
+        request req{id, std::move(args), {}};
+        auto result = req.result.get_future();
+        {
+            std::lock_guard<std::mutex> lk{queue_mtx_};
+            queue_.push_back(std::move(req));
+        }
+        queue_cv_.notify_one();
+        return result.get();
+    }
+
+    // evaluate queued requests in batches grouped by expression
+    void batch_loop()
+    {
+        std::vector<request> reqs;
+        tools::column_batch<Value> batch;
+        tools::columnar_sink<Value> sink;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk{queue_mtx_};
+                queue_cv_.wait(lk, [&]{ return !queue_.empty() || stop_; });
+                if (queue_.empty()) return;
+                reqs.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+                queue_.clear();
+            }
+            std::stable_sort(reqs.begin(), reqs.end(), [](const request& a, const request& b){ return a.id < b.id; });
+            for (auto first = reqs.begin(); first != reqs.end(); ) {
+                auto last = std::find_if(first, reqs.end(), [&](const request& r){ return r.id != first->id; });
+                compiled* expr;
+                {
+                    std::lock_guard<std::mutex> lk{exprs_mtx_};
+                    expr = &exprs_[first->id];  // std::deque keeps references stable
+                }
+                // arguments of requests become columns of batch
+                const std::size_t rows = static_cast<std::size_t>(last - first);
+                batch.columns.resize(expr->params.size());
+                for (std::size_t col = 0; col < expr->params.size(); ++col) {
+                    batch.columns[col].clear();
+                    for (auto it = first; it != last; ++it) {
+                        batch.columns[col].push_back(it->args[col]);
+                    }
+                }
+                batch.status.assign(rows, tools::row_status::ok);
+                sink.clear();
+                tools::eval_columns(expr->calc, expr->expr, expr->params, batch.span(), sink);
+                for (std::size_t i = 0; i < rows; ++i) {
+                    first[i].result.set_value({static_cast<std::uint8_t>(sink.errcs[i]), sink.results[i]});
+                }
+                ++batches_;
+                requests_ += rows;
+                first = last;
+            }
+            reqs.clear();
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk{queue_mtx_};
+            stop_ = true;
+        }
+        queue_cv_.notify_all();
+    }
+
+    // register accepted connection before serve() on another thread
+    void track(int fd)
+    {
+        std::lock_guard<std::mutex> lk{conns_mtx_};
+        conns_.insert(fd);
+    }
+
+    // serve requests of one connection until it is closed
+    void serve(int fd)
+    {
+        std::string msg;
+        while (tools::daemon::recv_message(fd, msg)) {
+            std::uint8_t status = tools::daemon::kBadRequest;
+            std::uint64_t payload = 0;
+            if (!msg.empty() && msg[0] == tools::daemon::kPrepare) {
+                std::vector<std::string> params;
+                std::uint32_t id;
+                if (parse_prepare(msg, params) && prepare(std::move(params), std::move(msg), id)) {
+                    status = 0;
+                    payload = id;
+                }
+            } else if (7 <= msg.size() && msg[0] == tools::daemon::kEval) {
+                auto id = static_cast<std::uint32_t>(tools::daemon::get_le(msg.data() + 1, 4));
+                auto nargs = static_cast<std::size_t>(tools::daemon::get_le(msg.data() + 5, 2));
+                if (msg.size() == 7 + 8 * nargs) {
+                    std::vector<Value> args(nargs);
+                    for (std::size_t i = 0; i < nargs; ++i) {
+                        args[i] = tools::daemon::from_wire<Value>(tools::daemon::get_le(msg.data() + 7 + 8 * i, 8));
+                    }
+                    Value val;
+                    std::tie(status, val) = eval(id, std::move(args));
+                    payload = tools::daemon::to_wire(val);
+                }
+            } else if (2 <= msg.size() && msg[0] == tools::daemon::kAttach) {
+                // segment must be owned by the client, and not by others
+                tools::shm::mapped_segment seg;
+                uid_t uid;
+                if (tools::shm::peer_uid(fd, uid) && seg.open(msg.substr(1), uid)) {
+                    if (tools::daemon::send_response(fd, 0, 0)) {
+                        serve_ring(fd, *seg.get());
+                    }
+                    break;
+                }
+            }
+            if (!tools::daemon::send_response(fd, status, payload)) break;
+        }
+        {
+            std::lock_guard<std::mutex> lk{conns_mtx_};
+            conns_.erase(fd);
+            conns_cv_.notify_all();
+        }
+        ::close(fd);
+    }
+
+    // shut down all connections, and wait until their threads finish
+    void disconnect_all()
+    {
+        std::unique_lock<std::mutex> lk{conns_mtx_};
+        for (int fd : conns_) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        conns_cv_.wait(lk, [&]{ return conns_.empty(); });
+    }
+
+    std::size_t batches() const noexcept { return batches_; }
+    std::size_t requests() const noexcept { return requests_; }
+    std::size_t ring_requests() const noexcept { return ring_requests_; }
+
+private:
+    struct compiled {
+        std::string expr;
+        std::vector<std::string> params;
+        tecalc::basic_calculator<Value> calc;
+    };
+    struct request {
+        std::uint32_t id;
+        std::vector<Value> args;
+        std::promise<std::pair<std::uint8_t, Value>> result;
+    };
+
+    // expression evaluated on connection thread, with its own calculator
+    struct local_expr {
+        compiled expr;
+        std::vector<Value*> vars;
+    };
+
+    // serve EVAL requests through shared-memory rings until closed by either side
+    void serve_ring(int fd, tools::shm::segment& seg)
+    {
+        // disconnect_all() shuts down socket, which is observed as EOF
+        auto stop = [&]{ return seg.is_closed() || tools::shm::impl::socket_closed(fd); };
+        // Evaluating on this thread bypasses batch_loop(), which modifies
+        // calculator of compiled expression without lock, so build own one
+        // from immutable proto_ and strings copied under lock.
+        std::map<std::uint32_t, local_expr> local;
+        tools::shm::request_slot req;
+        while (seg.requests.pop(req, seg.mode, stop)) {
+            tools::shm::response_slot res{tools::daemon::kBadRequest, 0};
+            auto it = local.find(req.id);
+            if (it == local.end()) {
+                std::unique_lock<std::mutex> lk{exprs_mtx_};
+                if (req.id < exprs_.size()) {
+                    local_expr e{{exprs_[req.id].expr, exprs_[req.id].params, {}}, {}};
+                    lk.unlock();
+                    e.expr.calc = proto_;
+                    for (const auto& name : e.expr.params) {
+                        e.expr.calc.bind_var(name, Value{});
+                        e.vars.push_back(e.expr.calc.find_var(name));
+                    }
+                    it = local.emplace(req.id, std::move(e)).first;
+                }
+            }
+            // nargs is written by client, and may exceed args[] of slot
+            if (it != local.end() && req.nargs <= tools::shm::kMaxArgs && req.nargs == it->second.vars.size()) {
+                local_expr& e = it->second;
+                for (std::size_t i = 0; i < e.vars.size(); ++i) {
+                    *e.vars[i] = tools::daemon::from_wire<Value>(req.args[i]);
+                }
+                auto r = e.expr.calc.try_eval(e.expr.expr);
+                res = {static_cast<std::uint8_t>(r.ec), tools::daemon::to_wire(r.value)};
+            }
+            if (!seg.responses.push(res, seg.mode, stop)) break;
+            ++ring_requests_;
+        }
+        seg.close();
+    }
+
+    // parse PREPARE payload, and leave expression in msg
+    static bool parse_prepare(std::string& msg, std::vector<std::string>& params)
+    {
+        if (msg.size() < 3) return false;
+        std::size_t n = static_cast<std::size_t>(tools::daemon::get_le(msg.data() + 1, 2));
+        std::size_t pos = 3;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (msg.size() < pos + 2) return false;
+            std::size_t len = static_cast<std::size_t>(tools::daemon::get_le(msg.data() + pos, 2));
+            pos += 2;
+            if (msg.size() < pos + len) return false;
+            params.emplace_back(msg, pos, len);
+            pos += len;
+        }
+        msg.erase(0, pos);
+        return true;
+    }
+
+    // preloaded bindings, which are never modified and shared by threads
+    const tecalc::basic_calculator<Value> proto_;
+    std::mutex exprs_mtx_;
+    std::map<std::string, std::uint32_t> ids_;
+    std::deque<compiled> exprs_;
+    std::mutex queue_mtx_;
+    std::condition_variable queue_cv_;
+    std::vector<request> queue_;
+    bool stop_ = false;
+    std::mutex conns_mtx_;
+    std::condition_variable conns_cv_;
+    std::set<int> conns_;
+    std::size_t batches_ = 0;
+    std::size_t requests_ = 0;
+    std::atomic<std::size_t> ring_requests_{0};
+};
+
+// bind NAME=VALUE definition, return false on error
+template <class Value>
+bool bind_definition(tecalc::basic_calculator<Value>& calc, std::string_view def)
+{
+    std::size_t eq = def.find('=');
+    Value val;
+    if (eq == std::string_view::npos || !tools::parse_csv_field(def.substr(eq + 1), val)) return false;
+    std::string_view name = def.substr(0, eq);
+    while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) name.remove_suffix(1);
+    calc.bind_var(std::string{name}, val);
+    return true;
+}
+
+template <class Value>
+int run(const char* path, const std::vector<std::string>& defines, const char* bindings)
+{
+    tecalc::basic_calculator<Value> proto;
+    for (const auto& def : defines) {
+        if (!bind_definition(proto, def)) {
+            std::fprintf(stderr, "tecalcd: invalid definition '%s'\n", def.c_str());
+            return 2;
+        }
+    }
+    if (bindings) {
+        tools::mapped_file file;
+        if (!file.open(bindings)) {
+            std::fprintf(stderr, "tecalcd: cannot read %s\n", bindings);
+            return 2;
+        }
+        std::string_view text = file.view();
+        for (std::size_t lineno = 1; !text.empty(); ++lineno) {
+            std::string_view line = tools::next_line(text);
+            if (!tools::is_blank(line) && !bind_definition(proto, line)) {
+                std::fprintf(stderr, "tecalcd: %s:%zu: invalid definition\n", bindings, lineno);
+                return 2;
+            }
+        }
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (sizeof(addr.sun_path) <= std::strlen(path)) {
+        std::fprintf(stderr, "tecalcd: too long socket path\n");
+        return 2;
+    }
+    std::strcpy(addr.sun_path, path);
+    int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    ::unlink(path);
+    if (lfd < 0 || ::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(lfd, 128) != 0) {
+        std::perror("tecalcd");
+        return 1;
+    }
+
+    // stop by SIGINT/SIGTERM, which interrupts accept()
+    struct sigaction sa{};
+    sa.sa_handler = on_signal;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    server<Value> srv{std::move(proto)};
+    std::thread batcher{[&]{ srv.batch_loop(); }};
+    int status = 0;
+    while (!g_stop) {
+        int fd = ::accept(lfd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // out of resources, wait for connections to be closed
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            std::perror("tecalcd: accept");
+            status = 1;
+            break;
+        }
+        srv.track(fd);
+        std::thread{[&srv, fd]{ srv.serve(fd); }}.detach();
+    }
+    ::close(lfd);
+    ::unlink(path);
+    srv.disconnect_all();
+    srv.stop();
+    batcher.join();
+    std::fprintf(stderr, "tecalcd: %zu requests in %zu batches, %zu requests through shared memory\n",
+                 srv.requests(), srv.batches(), srv.ring_requests());
+    return status;
+}
+
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    std::string type = "long";
+    std::vector<std::string> defines;
+    const char* bindings = nullptr;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc) {
+            type = argv[++i];
+        } else if (arg == "-D" && i + 1 < argc) {
+            defines.push_back(argv[++i]);
+        } else if (arg == "-b" && i + 1 < argc) {
+            bindings = argv[++i];
+        } else if (arg[0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!path) {
+        usage();
+        return 2;
+    }
+    if (type == "long") {
+        return run<long long>(path, defines, bindings);
+    } else if (type == "double") {
+        return run<double>(path, defines, bindings);
+    }
+    usage();
+    return 2;
+}